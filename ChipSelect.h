@@ -16,6 +16,16 @@ class AbstractChipSelect
     **/
     virtual void deselect() = 0;
 
+    /** \brief Called by Transfer programs to switch a data/command line to command mode.
+     * Chip selects without such a line can ignore this.
+    **/
+    virtual void command() {}
+
+    /** \brief Called by Transfer programs to switch a data/command line to data mode.
+     * Chip selects without such a line can ignore this.
+    **/
+    virtual void data() {}
+
     /** \brief the virtual destructor needed to inherit from this class **/
 		virtual ~AbstractChipSelect() {}
 };
@@ -118,5 +128,67 @@ class ActiveLowChipSelect1 : public AbstractChipSelect
 
 };
 
+/** \brief An active low chip select class with a data/command (DC) line, as used by TFT displays.
+ * This also configures both pins. DC is low for commands and high for data.
+**/
+class ActiveLowChipSelectDC : public AbstractChipSelect
+{
+  public:
+    /** Configures the chip select and DC pins for OUTPUT mode,
+     * manages the chip selection and a corresponding SPI transaction
+     *
+     * \param pin the CS pin to use
+     * \param dcPin the data/command pin to use
+     * \param settings which SPI settings to apply when the chip is selected
+     * \param spi the SPI the chip is connected to
+    **/
+    ActiveLowChipSelectDC(const unsigned int& pin, const unsigned int& dcPin, const SPISettings& settings, SPIClass& spi = SPI)
+      : pin_(pin),
+      dcPin_(dcPin),
+      settings_(settings),
+      spi_(spi)
+    {
+      pinMode(pin, OUTPUT);
+      digitalWriteFast(pin, 1);
+      pinMode(dcPin, OUTPUT);
+      digitalWriteFast(dcPin, 1);
+    }
+
+    /** \brief begins an SPI transaction and selects the chip (sets the pin to low)
+    **/
+    void select() override
+    {
+      spi_.beginTransaction(settings_);
+      digitalWriteFast(pin_, 0);
+    }
+
+    /** \brief deselects the chip (sets the pin to high) and ends the SPI transaction
+    **/
+    void deselect() override
+    {
+      digitalWriteFast(pin_, 1);
+      spi_.endTransaction();
+    }
+
+    /** \brief sets the DC pin to low
+    **/
+    void command() override
+    {
+      digitalWriteFast(dcPin_, 0);
+    }
+
+    /** \brief sets the DC pin to high
+    **/
+    void data() override
+    {
+      digitalWriteFast(dcPin_, 1);
+    }
+  private:
+    const unsigned int pin_;
+    const unsigned int dcPin_;
+    const SPISettings settings_;
+    SPIClass& spi_;
+};
+
 #endif // CHIPSELECT_H
 
@@ -8,6 +8,7 @@
   #error This library is for teensyduino 1.21 on Teensy 3.0, 3.1 and Teensy LC only.
 #endif
 
+#include <new>
 #include <SPI.h>
 #include "DMAChannel.h"
 #include "ChipSelect.h"
@@ -22,6 +23,287 @@
 
 namespace DmaSpi
 {
+  /** \brief Refers to a Transfer program, see DmaSpi::program.
+  **/
+  class Program
+  {
+    public:
+      constexpr explicit Program(const uint8_t* pCode) : m_pCode(pCode) {}
+      const uint8_t* m_pCode;
+  };
+
+  /** \brief Repeating patterns (see Transfer::setPattern() and program::eFill) are sent with the DMA source address
+   * modulo feature, so their length must divide the 16 byte pattern buffer.
+  **/
+  constexpr bool validPatternLength(const size_t& length)
+  {
+    return (length == 1) || (length == 2) || (length == 4) || (length == 8) || (length == 16);
+  }
+
+  /** \brief Transfer programs: command sequences that are replayed by the DmaSpi driver without CPU intervention.
+   *
+   * A program is a byte table, usually a constexpr array that stays in flash. Each step starts with an Opcode,
+   * some are followed by arguments. The DMA reads the bytes to send directly from the table.
+   * Use the DMASPI_* macros below to write programs and valid() to check them at compile time:
+   * \code
+   * constexpr uint8_t displayInit[] = {
+   *   DMASPI_SELECT,
+   *   DMASPI_COMMAND(0x01),
+   *   DMASPI_DESELECT,
+   *   DMASPI_DELAY(5),
+   *   DMASPI_SELECT,
+   *   DMASPI_COMMAND(0x3A), DMASPI_DATA(0x55),
+   *   DMASPI_DESELECT,
+   *   DMASPI_END
+   * };
+   * static_assert(DmaSpi::program::valid(displayInit), "invalid program");
+   * DmaSpi::Transfer init(DmaSpi::Program(displayInit), &cs);
+   * \endcode
+  **/
+  namespace program
+  {
+    enum Opcode : uint8_t
+    {
+      eEnd = 0, /**< End of program. Deselects the chip if necessary. **/
+      eSelect, /**< Select the chip. **/
+      eDeselect, /**< Deselect the chip. **/
+      eCommand, /**< Switch the chip select's DC line to command. **/
+      eData, /**< Switch the chip select's DC line to data. **/
+      eWrite, /**< Followed by a count n (1..255) and n bytes to send. Received data is discarded. **/
+      eDelay, /**< Followed by a 16 bit delay in ms (little endian). The bus is not released.
+                   The delay is timed by an IntervalTimer. If no PIT channel is free, or the delay is too long for one,
+                   it only ends when the DmaSpi's service() is called after it has elapsed. **/
+      eWriteRows, /**< Followed by a source pointer (32 bit), row length, row stride (in bytes) and row count (16 bit each, little endian).
+                      Sends rows of a 2D buffer, e.g. a framebuffer, straight from that buffer. Only for programs built at runtime. **/
+      eRead, /**< Followed by a destination pointer (32 bit) and a count (16 bit, 1..32767), little endian.
+                 Receives count bytes into the destination while sending 0xFF. Only for programs built at runtime. **/
+      eFill /**< Followed by a pattern length n (1, 2, 4, 8 or 16), n pattern bytes and a count (32 bit, little endian).
+                 Sends count bytes that repeat the pattern, e.g. a solid colour, without a source buffer. **/
+    };
+
+    /** \brief the number of arguments, used by the DMASPI_* macros **/
+    template<typename... Ts>
+    constexpr unsigned count(Ts...) {return sizeof...(Ts);}
+
+    constexpr bool validFrom(const uint8_t* p, const size_t& n, const size_t& i, const bool& selected)
+    {
+      return (i >= n) ? false
+        : (p[i] == eEnd) ? (i + 1 == n)
+        : (p[i] == eSelect) ? (!selected && validFrom(p, n, i + 1, true))
+        : (p[i] == eDeselect) ? (selected && validFrom(p, n, i + 1, false))
+        : ((p[i] == eCommand) || (p[i] == eData)) ? validFrom(p, n, i + 1, selected)
+        : (p[i] == eWrite) ? (selected && (i + 1 < n) && (p[i + 1] > 0) && validFrom(p, n, i + 2 + p[i + 1], selected))
+        : (p[i] == eDelay) ? validFrom(p, n, i + 3, selected)
+        : (p[i] == eWriteRows) ? (selected && validFrom(p, n, i + 11, selected))
+        : (p[i] == eRead) ? (selected && validFrom(p, n, i + 7, selected))
+        : (p[i] == eFill) ? (selected && (i + 1 < n) && validPatternLength(p[i + 1]) && validFrom(p, n, i + 6 + p[i + 1], selected))
+        : false;
+    }
+
+    /** \brief Check a program at compile time.
+     * \return true if all opcodes are known, writes only happen while the chip is selected and the program ends with eEnd.
+    **/
+    template<size_t N>
+    constexpr bool valid(const uint8_t (&p)[N])
+    {
+      return validFrom(p, N, 0, false);
+    }
+
+    /** \brief Writes a program into a RAM buffer, for sequences that are only known at runtime.
+     *
+     * Steps that don't fit into the buffer are dropped and ok() returns false.
+    **/
+    class Builder
+    {
+      public:
+        Builder(uint8_t* pBuffer, const size_t& size)
+          : m_pBuffer(pBuffer),
+          m_size(size),
+          m_length(0),
+          m_ok(true)
+        {}
+
+        /** \brief Start over with an empty program. **/
+        void clear() {m_length = 0; m_ok = true;}
+
+        Builder& select() {return opcode_(eSelect);}
+        Builder& deselect() {return opcode_(eDeselect);}
+        Builder& command() {return opcode_(eCommand);}
+        Builder& data() {return opcode_(eData);}
+        Builder& end() {return opcode_(eEnd);}
+
+        /** \brief Append a write step. The bytes are copied into the program. **/
+        Builder& write(const uint8_t* pData, const uint8_t& count)
+        {
+          if ((count != 0) && reserve_(2 + count))
+          {
+            put_(eWrite);
+            put_(count);
+            for (uint8_t i = 0; i < count; i++)
+            {
+              put_(pData[i]);
+            }
+          }
+          return *this;
+        }
+
+        Builder& write(const uint8_t& value) {return write(&value, 1);}
+
+        /** \brief Append a write step that sends rows from a 2D buffer. The buffer is not copied and must remain valid.
+         * \param pSource the first byte of the first row
+         * \param rowLength number of bytes per row (1..32767)
+         * \param stride distance between the beginnings of two rows in bytes
+         * \param rows number of rows
+        **/
+        Builder& writeRows(const void* pSource, const uint16_t& rowLength, const uint16_t& stride, const uint16_t& rows)
+        {
+          if ((rowLength == 0) || (rowLength >= 0x8000) || (rows == 0))
+          {
+            return *this;
+          }
+          if (reserve_(11))
+          {
+            put_(eWriteRows);
+            putPointer_(pSource);
+            put16_(rowLength);
+            put16_(stride);
+            put16_(rows);
+          }
+          return *this;
+        }
+
+        /** \brief Append a read step. The destination must remain valid.
+         * \param pDest where to put the received bytes
+         * \param count number of bytes to receive (1..32767)
+        **/
+        Builder& read(volatile void* pDest, const uint16_t& count)
+        {
+          if ((count == 0) || (count >= 0x8000))
+          {
+            return *this;
+          }
+          if (reserve_(7))
+          {
+            put_(eRead);
+            putPointer_((const volatile void*)pDest);
+            put16_(count);
+          }
+          return *this;
+        }
+
+        /** \brief Append a fill step. The pattern is copied into the program.
+         * \param pPattern the bytes to repeat
+         * \param length the pattern length: 1, 2, 4, 8 or 16
+         * \param count number of bytes to send
+        **/
+        Builder& fill(const void* pPattern, const uint8_t& length, const uint32_t& count)
+        {
+          if (!validPatternLength(length) || (count == 0))
+          {
+            return *this;
+          }
+          if (reserve_(6 + length))
+          {
+            put_(eFill);
+            put_(length);
+            for (uint8_t i = 0; i < length; i++)
+            {
+              put_(((const uint8_t*)pPattern)[i]);
+            }
+            put16_(count);
+            put16_(count >> 16);
+          }
+          return *this;
+        }
+
+        Builder& delay(const uint16_t& ms)
+        {
+          if (reserve_(3))
+          {
+            put_(eDelay);
+            put16_(ms);
+          }
+          return *this;
+        }
+
+        /** \brief true if all steps fit into the buffer **/
+        bool ok() const {return m_ok;}
+
+        size_t length() const {return m_length;}
+
+        Program program() const {return Program(m_pBuffer);}
+
+      private:
+        Builder& opcode_(const uint8_t& opcode)
+        {
+          if (reserve_(1))
+          {
+            put_(opcode);
+          }
+          return *this;
+        }
+
+        bool reserve_(const size_t& n)
+        {
+          if (m_length + n > m_size)
+          {
+            m_ok = false;
+          }
+          return m_ok;
+        }
+
+        void put_(const uint8_t& value) {m_pBuffer[m_length++] = value;}
+        void put16_(const uint16_t& value) {put_(value & 0xFF); put_(value >> 8);}
+
+        void putPointer_(const volatile void* p)
+        {
+          const uintptr_t address = (uintptr_t)p;
+          put16_(address);
+          put16_(address >> 16);
+        }
+
+        uint8_t* m_pBuffer;
+        size_t m_size;
+        size_t m_length;
+        bool m_ok;
+    };
+  } // namespace program
+
+  /** \brief Parameters for the CRC module (Teensy 3.x only), see Transfer.
+   *
+   * The CRC module can only complement the result, so the final xor value is either 0 or all ones.
+  **/
+  struct Crc
+  {
+    constexpr Crc(const uint8_t& width_,
+                  const uint32_t& polynomial_,
+                  const uint32_t& seed_,
+                  const bool& reflectIn_,
+                  const bool& reflectOut_,
+                  const bool& complement_)
+      : width(width_),
+      polynomial(polynomial_),
+      seed(seed_),
+      reflectIn(reflectIn_),
+      reflectOut(reflectOut_),
+      complement(complement_)
+    {}
+
+    uint8_t width; /**< 16 or 32 **/
+    uint32_t polynomial;
+    uint32_t seed;
+    bool reflectIn;
+    bool reflectOut;
+    bool complement;
+  };
+
+  /** \brief CRC-16/XMODEM, as used for SD card data blocks **/
+  constexpr Crc crc16Xmodem(16, 0x1021, 0x0000, false, false, false);
+  /** \brief CRC-16/CCITT-FALSE **/
+  constexpr Crc crc16CcittFalse(16, 0x1021, 0xFFFF, false, false, false);
+  /** \brief CRC-32 as used by Ethernet, zip etc. **/
+  constexpr Crc crc32(32, 0x04C11DB7, 0xFFFFFFFF, true, true, true);
+
   /** \brief describes an SPI transfer
    *
    * Transfers are kept in a queue (intrusive linked list) until they are processed by the DmaSpi driver.
@@ -39,7 +321,9 @@ namespace DmaSpi
         eDone, /**< The Transfer is done. **/
         pending, /**< Queued, but not handled yet. **/
         inProgress, /**< The DmaSpi driver is currently busy executing this Transfer. **/
-        error /**< An error occured. **/
+        error, /**< An error occured. **/
+        cancelled, /**< The Transfer was cancelled before it was done. **/
+        timedOut /**< The Transfer took longer than its timeout and was aborted. **/
       };
 
       /** \brief Creates a Transfer object.
@@ -49,23 +333,56 @@ namespace DmaSpi
       * \param fill if pSource is nullptr, this value is sent to the slave instead.
       * \param cs pointer to a chip select object.
       *   If not nullptr, cs->select() is called when the Transfer is started and cs->deselect() is called when the Transfer is finished.
+      * \param pCrc if not nullptr, the CRC of the received data is calculated by the CRC module while the Transfer runs,
+      *   and available through crc() when it's done. This needs a data sink and a DmaSpi that was started with CRC support.
       **/
       Transfer(const uint8_t* pSource = nullptr,
                   const uint16_t& transferCount = 0,
                   volatile uint8_t* pDest = nullptr,
                   const uint8_t& fill = 0,
-                  AbstractChipSelect* cs = nullptr
+                  AbstractChipSelect* cs = nullptr,
+                  const Crc* pCrc = nullptr
       ) : m_state(State::idle),
         m_pSource(pSource),
         m_transferCount(transferCount),
         m_pDest(pDest),
         m_fill(fill),
         m_pNext(nullptr),
-        m_pSelect(cs)
+        m_pSelect(cs),
+        m_pProgram(nullptr),
+        m_pCrc(pCrc),
+        m_crc(0),
+        m_timeout(0),
+        m_pPattern(nullptr),
+        m_patternLength(0)
       {
           DMASPI_PRINT(("Transfer @ %p\n", this));
       };
 
+      /** \brief Creates a Transfer that runs a program.
+      * \param program the program to run, see DmaSpi::program. It must remain valid until the Transfer is done.
+      * \param cs pointer to a chip select object. It is selected and deselected by the program, not by the Transfer.
+      *   If nullptr, the select and deselect steps begin and end a default SPI transaction.
+      **/
+      Transfer(const Program& program,
+                  AbstractChipSelect* cs = nullptr
+      ) : m_state(State::idle),
+        m_pSource(nullptr),
+        m_transferCount(0),
+        m_pDest(nullptr),
+        m_fill(0),
+        m_pNext(nullptr),
+        m_pSelect(cs),
+        m_pProgram(program.m_pCode),
+        m_pCrc(nullptr),
+        m_crc(0),
+        m_timeout(0),
+        m_pPattern(nullptr),
+        m_patternLength(0)
+      {
+          DMASPI_PRINT(("Transfer @ %p, program @ %p\n", this, m_pProgram));
+      };
+
       /** \brief Check if the Transfer is busy, i.e. may not be modified.
       **/
       bool busy() const {return ((m_state == State::pending) || (m_state == State::inProgress) || (m_state == State::error));}
@@ -74,6 +391,34 @@ namespace DmaSpi
       **/
       bool done() const {return (m_state == State::eDone);}
 
+      /** \brief The CRC of the received data, valid when the Transfer is done.
+      **/
+      uint32_t crc() const {return m_crc;}
+
+      /** \brief Set a deadline for the Transfer, counted from when the DmaSpi starts it.
+      * If it's still in progress after that time, it is aborted with state timedOut.
+      * The timeout is timed by an IntervalTimer, or by the DmaSpi's service() if no PIT channel is free.
+      * \param ms the timeout in ms, 0 means no timeout.
+      **/
+      void setTimeout(const uint32_t& ms) {m_timeout = ms;}
+
+      /** \brief Send a repeating pattern instead of the fill value, if the Transfer has no data source.
+      * The pattern is copied when the Transfer starts, so it needs to remain valid until then.
+      * \param pPattern the bytes to repeat, nullptr to go back to the fill value
+      * \param length the pattern length: 1, 2, 4, 8 or 16
+      * \return false if the length is invalid
+      **/
+      bool setPattern(const uint8_t* pPattern, const uint8_t& length)
+      {
+        if ((pPattern != nullptr) && !validPatternLength(length))
+        {
+          return false;
+        }
+        m_pPattern = pPattern;
+        m_patternLength = length;
+        return true;
+      }
+
 //      private:
       volatile State m_state;
       const uint8_t* m_pSource;
@@ -82,9 +427,158 @@ namespace DmaSpi
       uint8_t m_fill;
       Transfer* m_pNext;
       AbstractChipSelect* m_pSelect;
+      const uint8_t* m_pProgram;
+      const Crc* m_pCrc;
+      volatile uint32_t m_crc;
+      uint32_t m_timeout;
+      const uint8_t* m_pPattern;
+      uint8_t m_patternLength;
+  };
+
+  /** \brief eDMA bandwidth control: engine stalls inserted after each read/write of a channel.
+   *
+   * Stalls leave crossbar slots to other bus masters and DMA channels, e.g. an audio DMA.
+  **/
+  enum class Bandwidth : uint8_t
+  {
+    noStall = 0, /**< no engine stalls **/
+    stall4 = 2, /**< the engine stalls for 4 cycles after each r/w **/
+    stall8 = 3 /**< the engine stalls for 8 cycles after each r/w **/
   };
+
+  /** \brief Arbitration settings for a single DMA channel.
+  **/
+  struct ChannelOptions
+  {
+    /** \brief Creates a set of channel options.
+    * \param priority_ the channel priority (DCHPRI), 0 (lowest) .. 15, larger values are limited to 15.
+    *   Priorities are unique within each group of 16 channels. The Teensy 3.0 has only 4 channels,
+    *   so there the priority is 0 .. 3 and limited to 3.
+    *   A negative value keeps the priority the channel already has.
+    * \param preemptible_ if true, a higher priority channel may suspend this channel (ECP).
+    * \param canPreempt_ if false, this channel may not suspend lower priority channels (DPA).
+    * \param bandwidth_ engine stalls after each r/w of this channel (BWC).
+    **/
+    ChannelOptions(const int8_t& priority_ = -1,
+                   const bool& preemptible_ = false,
+                   const bool& canPreempt_ = true,
+                   const Bandwidth& bandwidth_ = Bandwidth::noStall)
+      : priority(priority_),
+      preemptible(preemptible_),
+      canPreempt(canPreempt_),
+      bandwidth(bandwidth_)
+    {}
+
+    int8_t priority;
+    bool preemptible;
+    bool canPreempt;
+    Bandwidth bandwidth;
+  };
+
+  /** \brief Options for one DmaSpi: arbitration settings for the rx and tx channel, and CRC support.
+   *
+   * The rx channel always ends up with a higher priority than the tx channel,
+   * otherwise the tx channel could fill the SPI faster than rx drains it and the rx FIFO would overrun.
+  **/
+  struct BusOptions
+  {
+    /** \param crc_ if true, a third DMA channel is allocated that feeds received data to the CRC module (Teensy 3.x only).
+     *    There is only one CRC module, so only one DmaSpi can have CRC support.
+    **/
+    BusOptions(const ChannelOptions& rx_ = ChannelOptions(),
+               const ChannelOptions& tx_ = ChannelOptions(),
+               const bool& crc_ = false)
+      : rx(rx_),
+      tx(tx_),
+      crc(crc_)
+    {}
+
+    ChannelOptions rx;
+    ChannelOptions tx;
+    bool crc;
+  };
+
+  /** \brief Static storage for a DMAChannel object.
+   *
+   * The object, and with it the hardware DMA channel, only exists between acquire() and release().
+   * Nothing is allocated on the heap, and a released channel can be acquired again.
+  **/
+  class ChannelStorage
+  {
+    public:
+      constexpr ChannelStorage() : m_storage(), m_acquired(false) {}
+
+      /** \brief Construct the DMAChannel, which allocates a hardware channel.
+      * \return the channel, or nullptr if no hardware channel was available.
+      **/
+      DMAChannel* acquire()
+      {
+        if (!m_acquired)
+        {
+          new (m_storage) DMAChannel();
+          m_acquired = true;
+        }
+        if (get()->channel >= DMA_NUM_CHANNELS)
+        {
+          release();
+          return nullptr;
+        }
+        return get();
+      }
+
+      /** \brief Destroy the DMAChannel, which frees the hardware channel. Does nothing if it was not acquired.
+      **/
+      void release()
+      {
+        if (m_acquired)
+        {
+          get()->~DMAChannel();
+          m_acquired = false;
+        }
+      }
+
+      bool acquired() const {return m_acquired;}
+
+      /** \brief Exchange the hardware channels of two acquired storages, before they are set up.
+      **/
+      void swap(ChannelStorage& other)
+      {
+        uint8_t storage[sizeof(DMAChannel)];
+        memcpy(storage, m_storage, sizeof(DMAChannel));
+        memcpy(m_storage, other.m_storage, sizeof(DMAChannel));
+        memcpy(other.m_storage, storage, sizeof(DMAChannel));
+      }
+
+      /** \brief the channel. Only valid while acquired. **/
+      DMAChannel* get() {return reinterpret_cast<DMAChannel*>(m_storage);}
+
+    private:
+      alignas(DMAChannel) uint8_t m_storage[sizeof(DMAChannel)];
+      bool m_acquired;
+  };
+
+  /** \brief The DmaSpi that owns the CRC module, if any. **/
+  inline const void*& crcOwner()
+  {
+    static const void* pOwner = nullptr;
+    return pOwner;
+  }
 } // namespace DmaSpi
 
+/** \name Transfer program steps, see DmaSpi::program
+ * @{
+**/
+#define DMASPI_END DmaSpi::program::eEnd
+#define DMASPI_SELECT DmaSpi::program::eSelect
+#define DMASPI_DESELECT DmaSpi::program::eDeselect
+#define DMASPI_WRITE(...) DmaSpi::program::eWrite, DmaSpi::program::count(__VA_ARGS__), __VA_ARGS__
+#define DMASPI_COMMAND(...) DmaSpi::program::eCommand, DMASPI_WRITE(__VA_ARGS__)
+#define DMASPI_DATA(...) DmaSpi::program::eData, DMASPI_WRITE(__VA_ARGS__)
+#define DMASPI_DELAY(ms) DmaSpi::program::eDelay, ((ms) & 0xFF), (((ms) >> 8) & 0xFF)
+#define DMASPI_FILL(n, ...) DmaSpi::program::eFill, DmaSpi::program::count(__VA_ARGS__), __VA_ARGS__, \
+  ((n) & 0xFF), (((n) >> 8) & 0xFF), (((n) >> 16) & 0xFF), (((n) >> 24) & 0xFF)
+/** @} **/
+
 template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
 class AbstractDmaSpi
 {
@@ -93,33 +587,39 @@ class AbstractDmaSpi
 
    /** \brief arduino-style initialization.
      *
-     * During initialization, two DMA channels are allocated. If that fails, this function returns false.
+     * During initialization, two DMA channels are acquired. If that fails, this function returns false.
+     * The DMAChannel objects live in static storage, so there is no heap allocation and begin() may be called again after end().
      * If the channels could be allocated, those DMA channel fields that don't change during DMA SPI operation
      * are initialized to the values they will have at runtime.
      *
+     * The channels' priority, preemption and bandwidth settings are then set according to options.
+     * Only the first call applies them, use appliedOptions() to see what the hardware ended up with.
+     * On the Teensy LC, channel priority is fixed by the channel number and the options are ignored.
+     *
+     * \param options arbitration settings for the rx and tx DMA channels.
      * \return true if initialization was successful; false otherwise.
      * \see end()
+     * \see appliedOptions()
     **/
-    static bool begin()
+    static bool begin(const DmaSpi::BusOptions& options = DmaSpi::BusOptions())
     {
       if(init_count_ > 0)
       {
+        init_count_++;
         return true; // this is not particularly bad, so we can return true
       }
-      init_count_++;
       DMASPI_PRINT(("DmaSpi::begin() : "));
-      // create DMA channels, might fail
-      if (!createDmaChannels())
+      // acquire DMA channels, might fail
+      if (!acquireDmaChannels())
       {
-        DMASPI_PRINT(("could not create DMA channels\n"));
+        DMASPI_PRINT(("could not acquire DMA channels\n"));
         return false;
       }
-      state_ = eStopped;
       // tx: known destination (SPI), no interrupt, finish silently
       begin_setup_txChannel();
       if (txChannel_()->error())
       {
-        destroyDmaChannels();
+        releaseDmaChannels();
         DMASPI_PRINT(("tx channel error\n"));
         return false;
       }
@@ -128,14 +628,50 @@ class AbstractDmaSpi
       begin_setup_rxChannel();
       if (rxChannel_()->error())
       {
-        destroyDmaChannels();
+        releaseDmaChannels();
         DMASPI_PRINT(("rx channel error\n"));
         return false;
       }
 
+      applyOptions_(options);
+
+      // crc: fed by the rx channel, interrupt on completion
+      if (options.crc && !begin_setup_crcChannel_())
+      {
+        releaseDmaChannels();
+        DMASPI_PRINT(("crc channel error\n"));
+        return false;
+      }
+
+      // forget anything left over from before a previous end()
+      m_pCurrentTransfer = nullptr;
+      m_pNextTransfer = nullptr;
+      m_pLastTransfer = nullptr;
+      m_pStep_ = nullptr;
+      m_rowsLeft_ = 0;
+      m_fillLeft_ = 0;
+      m_selected_ = false;
+      m_delaying_ = false;
+      state_ = eStopped;
+      init_count_++;
       return true;
     }
 
+    /** \brief Read back the arbitration settings of the rx and tx DMA channels.
+     * \return the options as they are currently set in the DMA controller.
+     * On the Teensy LC, the reported priority reflects the fixed channel order.
+     * Before begin() and after the final end(), no channels are allocated and default options are returned.
+     * \see begin()
+    **/
+    static DmaSpi::BusOptions appliedOptions()
+    {
+      if (!m_rxChannel_.acquired() || !m_txChannel_.acquired())
+      {
+        return DmaSpi::BusOptions();
+      }
+      return DmaSpi::BusOptions(readChannelOptions_(*rxChannel_()), readChannelOptions_(*txChannel_()), m_crcEnabled_);
+    }
+
     static void begin_setup_txChannel() {DMASPI_INSTANCE::begin_setup_txChannel_impl();}
     static void begin_setup_rxChannel() {DMASPI_INSTANCE::begin_setup_rxChannel_impl();}
 
@@ -185,14 +721,20 @@ class AbstractDmaSpi
 
     /** \brief register a Transfer to be handled by the DMA SPI.
      * \return false if the Transfer had an invalid transfer count (zero or greater than 32767), true otherwise.
+     * Transfers that run a program have no transfer count.
+     * Transfers with a CRC are invalid if they run a program, have no data sink or CRC support was not enabled in begin().
      * \post the Transfer state is Transfer::State::pending, or Transfer::State::error if the transfer count was invalid.
     **/
     static bool registerTransfer(Transfer& transfer)
     {
       DMASPI_PRINT(("DmaSpi::registerTransfer(%p)\n", &transfer));
+      service();
       if ((transfer.busy())
-       || (transfer.m_transferCount == 0) // no zero length transfers allowed
-       || (transfer.m_transferCount >= 0x8000)) // max CITER/BITER count with ELINK = 0 is 0x7FFF, so reject
+       || ((transfer.m_pProgram == nullptr)
+        && ((transfer.m_transferCount == 0) // no zero length transfers allowed
+         || (transfer.m_transferCount >= 0x8000))) // max CITER/BITER count with ELINK = 0 is 0x7FFF, so reject
+       || ((transfer.m_pCrc != nullptr)
+        && (!m_crcEnabled_ || (transfer.m_pProgram != nullptr) || (transfer.m_pDest == nullptr))))
       {
         DMASPI_PRINT(("  Transfer is busy or invalid, dropped\n"));
         transfer.m_state = Transfer::State::error;
@@ -223,6 +765,99 @@ class AbstractDmaSpi
       return (m_pCurrentTransfer != nullptr);
     }
 
+    /** \brief Abort a Transfer that has exceeded its timeout, and resume a Transfer program whose delay step has elapsed,
+     * if they could not be timed by an IntervalTimer.
+     *
+     * Timeouts and delays normally use a PIT channel each while they run. Only if none was free, call this regularly
+     * (e.g. from loop()) while such Transfers are running.
+     * wait() and waitAll() call it while they wait, and registerTransfer() calls it once.
+     * \see Transfer::setTimeout()
+    **/
+    static void service()
+    {
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+      {
+        if ((m_pCurrentTransfer != nullptr)
+         && m_watchdogPolled_
+         && (millis() - m_startedAt_ > m_pCurrentTransfer->m_timeout))
+        {
+          DMASPI_PRINT(("DmaSpi::service() : timeout of %p\n", m_pCurrentTransfer));
+          abortCurrentTransfer_(Transfer::State::timedOut);
+        }
+        else if (m_delaying_ && m_delayPolled_ && ((int32_t)(millis() - m_resumeAt_) >= 0))
+        {
+          DMASPI_PRINT(("DmaSpi::service() : delay elapsed\n"));
+          endDelay_();
+        }
+      }
+    }
+
+    /** \brief Cancel a Transfer.
+     *
+     * A pending Transfer is removed from the queue. A Transfer in progress is aborted: its DMA channels are stopped,
+     * the SPI FIFOs are flushed and the chip is deselected. The DMA SPI then continues with the next pending Transfer.
+     * Data that was already sent or received is not undone.
+     * \return true if the Transfer was cancelled, false if it was neither pending nor in progress.
+     * \post the Transfer state is Transfer::State::cancelled if true was returned.
+    **/
+    static bool cancel(Transfer& transfer)
+    {
+      bool result = false;
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+      {
+        if (&transfer == m_pCurrentTransfer)
+        {
+          DMASPI_PRINT(("DmaSpi::cancel(%p) : aborting\n", &transfer));
+          abortCurrentTransfer_(Transfer::State::cancelled);
+          result = true;
+        }
+        else if ((transfer.m_state == Transfer::State::pending) && removeTransferFromQueue_(transfer))
+        {
+          DMASPI_PRINT(("DmaSpi::cancel(%p) : removed from queue\n", &transfer));
+          transfer.m_state = Transfer::State::cancelled;
+          result = true;
+        }
+      }
+      return result;
+    }
+
+    /** \brief Wait until a Transfer has finished, sleeping the core between interrupts.
+     *
+     * The core is put to sleep with WFI and re-checks the Transfer after every interrupt, which saves power
+     * and leaves the bus to the DMA. Transfer program delays are resumed while waiting.
+     * If the DMA SPI is stopped, a pending Transfer doesn't finish, so only the timeout ends the wait.
+     * \param transfer the Transfer to wait for.
+     * \param timeout maximum time to wait in ms, 0 waits forever.
+     * \return true if the Transfer is done, false if it failed or the timeout has elapsed.
+     * \see waitAll()
+     * \see lastWakeLatency()
+    **/
+    static bool wait(const Transfer& transfer, const uint32_t& timeout = 0)
+    {
+      sleepWhile_(transferActive_, &transfer, timeout);
+      return transfer.done();
+    }
+
+    /** \brief Wait until all registered Transfers have finished, sleeping the core between interrupts.
+     *
+     * If the DMA SPI is stopped, pending Transfers are not waited for.
+     * \param timeout maximum time to wait in ms, 0 waits forever.
+     * \return true if the DMA SPI is idle, false if the timeout has elapsed.
+     * \see wait()
+    **/
+    static bool waitAll(const uint32_t& timeout = 0)
+    {
+      return sleepWhile_(queueActive_, nullptr, timeout);
+    }
+
+    /** \brief The time between the last DMA SPI interrupt and the resumption of a waiting wait() or waitAll() call.
+     * \return the latency in CPU cycles (measured with the SysTick timer).
+    **/
+    static uint32_t lastWakeLatency()
+    {
+      return m_wakeLatency_;
+    }
+
     /** \brief Request the DMA SPI to stop handling Transfers.
      *
      * The stopping driver may finish a current Transfer, but it will then not start a new, pending one.
@@ -283,6 +918,8 @@ class AbstractDmaSpi
     /** \brief Shut down the DMA SPI
      *
      * Deallocates DMA channels and sets the internal state to error (this might not be an intelligent name for that)
+     * The final end() aborts the current Transfer and cancels all pending ones, their state becomes
+     * Transfer::State::cancelled. The arbitration settings changed by begin() are restored.
      * \see begin()
     **/
     static void end()
@@ -295,7 +932,11 @@ class AbstractDmaSpi
       if (init_count_ == 1)
       {
         init_count_--;
-        destroyDmaChannels();
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+          cancelAll_();
+        }
+        releaseDmaChannels();
         state_ = eError;
         return;
       }
@@ -322,6 +963,9 @@ class AbstractDmaSpi
       eError
     };
 
+    /** \brief how long abort() waits for a byte that is still shifting, in us. One frame at 80 kHz. **/
+    static const uint32_t abortFrameTimeout_ = 100;
+
     static void addTransferToQueue(Transfer& transfer)
     {
       transfer.m_state = Transfer::State::pending;
@@ -342,8 +986,155 @@ class AbstractDmaSpi
     }
 
     static void post_finishCurrentTransfer() {DMASPI_INSTANCE::post_finishCurrentTransfer_impl();}
+    static void abort() {DMASPI_INSTANCE::abort_impl();}
+
+    /** \brief Cancel all pending Transfers, then abort the current one. Interrupts must be disabled.
+    **/
+    static void cancelAll_()
+    {
+      for (Transfer* pTransfer = m_pNextTransfer; pTransfer != nullptr; )
+      {
+        Transfer* pNext = pTransfer->m_pNext;
+        pTransfer->m_state = Transfer::State::cancelled;
+        pTransfer->m_pNext = nullptr;
+        pTransfer = pNext;
+      }
+      m_pNextTransfer = nullptr;
+      m_pLastTransfer = nullptr;
+      if (m_pCurrentTransfer != nullptr)
+      {
+        DMASPI_PRINT(("  aborting %p\n", m_pCurrentTransfer));
+        abortCurrentTransfer_(Transfer::State::cancelled);
+      }
+    }
+
+    static bool removeTransferFromQueue_(Transfer& transfer)
+    {
+      Transfer* pPrevious = nullptr;
+      for (Transfer* pTransfer = m_pNextTransfer; pTransfer != nullptr; pTransfer = pTransfer->m_pNext)
+      {
+        if (pTransfer == &transfer)
+        {
+          if (pPrevious == nullptr)
+          {
+            m_pNextTransfer = transfer.m_pNext;
+          }
+          else
+          {
+            pPrevious->m_pNext = transfer.m_pNext;
+          }
+          if (m_pLastTransfer == &transfer)
+          {
+            m_pLastTransfer = pPrevious;
+          }
+          transfer.m_pNext = nullptr;
+          return true;
+        }
+        pPrevious = pTransfer;
+      }
+      return false;
+    }
+
+    /** \brief Stop the DMA of the current Transfer, flush the SPI and end the Transfer with the given state.
+     * Interrupts must be disabled.
+    **/
+    static void abortCurrentTransfer_(const Transfer::State& state)
+    {
+      rxChannel_()->disable();
+      txChannel_()->disable();
+      // a completion interrupt that is already pending must not end the next Transfer
+      rxChannel_()->clearInterrupt();
+#if defined(KINETISK)
+      if (m_pCurrentTransfer->m_pCrc != nullptr)
+      {
+        crcChannel_()->disable();
+        // disabling only stops new requests, a minor loop that already started runs to its end
+        while (crcChannel_()->TCD->CSR & (DMA_TCD_CSR_ACTIVE | DMA_TCD_CSR_START))
+        {
+        }
+        crcChannel_()->clearInterrupt();
+        rxChannel_()->TCD->CSR = (rxChannel_()->TCD->CSR & ~(DMA_TCD_CSR_MAJORELINK | DMA_TCD_CSR_DONE)) | DMA_TCD_CSR_INTMAJOR;
+      }
+#endif
+      abort();
+      m_pStep_ = nullptr;
+      m_rowsLeft_ = 0;
+      m_fillLeft_ = 0;
+      m_delayTimer_.end();
+      m_delaying_ = false;
+      completeCurrentTransfer_(state);
+    }
+
+    static bool transferActive_(const Transfer* pTransfer)
+    {
+      return (pTransfer->m_state == Transfer::State::pending) || (pTransfer->m_state == Transfer::State::inProgress);
+    }
+
+    static bool queueActive_(const Transfer*)
+    {
+      return busy() || ((state_ == eRunning) && (m_pNextTransfer != nullptr));
+    }
+
+    /** \brief Check if a channel has really requested an interrupt, and not just left an NVIC entry behind
+     * when its Transfer was aborted.
+    **/
+    static bool interruptPending_(DMAChannel* pChannel)
+    {
+#if defined(KINETISK)
+      return (DMA_INT & (1 << pChannel->channel)) != 0;
+#elif defined(KINETISL)
+      return (pChannel->CFG->DSR_BCR & DMA_DSR_BCR_DONE) != 0;
+#endif
+    }
 
-    static void finishCurrentTransfer()
+    /** \brief Sleep until active(pTransfer) returns false or the timeout (in ms, 0: none) elapses.
+     * \return true if active() returned false
+    **/
+    static bool sleepWhile_(bool (*active)(const Transfer*), const Transfer* pTransfer, const uint32_t& timeout)
+    {
+      const uint32_t start = millis();
+      for (;;)
+      {
+        service();
+        // interrupts are masked between the check and WFI, so a completion can't slip in between.
+        // A pending interrupt still wakes the core, and its ISR runs as soon as they are unmasked.
+        __disable_irq();
+        if (!active(pTransfer))
+        {
+          __enable_irq();
+          return true;
+        }
+        if ((timeout != 0) && (millis() - start >= timeout))
+        {
+          __enable_irq();
+          return false;
+        }
+        asm volatile("wfi");
+        __enable_irq();
+        const uint32_t now = SYST_CVR;
+        if (!active(pTransfer))
+        {
+          // SysTick counts down and wraps every millisecond
+          const uint32_t isr = m_isrTick_;
+          m_wakeLatency_ = (isr >= now) ? (isr - now) : (isr + SYST_RVR + 1 - now);
+        }
+      }
+    }
+
+    static void select_()
+    {
+      if (m_pCurrentTransfer->m_pSelect != nullptr)
+      {
+        m_pCurrentTransfer->m_pSelect->select();
+      }
+      else
+      {
+        m_Spi.beginTransaction(SPISettings());
+      }
+      m_selected_ = true;
+    }
+
+    static void deselect_()
     {
       if (m_pCurrentTransfer->m_pSelect != nullptr)
       {
@@ -353,56 +1144,344 @@ class AbstractDmaSpi
       {
         m_Spi.endTransaction();
       }
-      m_pCurrentTransfer->m_state = Transfer::State::eDone;
+      m_selected_ = false;
+    }
+
+    static void finishCurrentTransfer(const Transfer::State& state = Transfer::State::eDone)
+    {
+      m_watchdogTimer_.end();
+      m_watchdogPolled_ = false;
+      if (m_selected_)
+      {
+        deselect_();
+      }
+      m_pCurrentTransfer->m_state = state;
       DMASPI_PRINT(("  finishCurrentTransfer() @ %p\n", m_pCurrentTransfer));
       m_pCurrentTransfer = nullptr;
       post_finishCurrentTransfer();
     }
 
-    static bool createDmaChannels()
+    static bool acquireDmaChannels()
+    {
+      // rx first: on the Teensy LC, the lower channel number has the higher priority
+      if (m_rxChannel_.acquire() == nullptr)
+      {
+        return false;
+      }
+      if (m_txChannel_.acquire() == nullptr)
+      {
+        m_rxChannel_.release();
+        return false;
+      }
+#if defined(KINETISK)
+      // priorities only order channels within a group of 16, between groups the group priority decides
+      if (groupPriority_(rxChannel_()->channel) < groupPriority_(txChannel_()->channel))
+      {
+        m_rxChannel_.swap(m_txChannel_);
+      }
+      // remembered for releaseDmaChannels()
+      m_rxPriority_ = channelPriorityRegister_(rxChannel_()->channel);
+      m_txPriority_ = channelPriorityRegister_(txChannel_()->channel);
+#endif
+      return true;
+    }
+
+    static void releaseDmaChannels()
+    {
+#if defined(KINETISK)
+      // undo the priority changes in reverse order, each may have displaced another channel
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+      {
+        if (m_crcEnabled_)
+        {
+          restoreChannelPriority_(*crcChannel_(), m_crcPriority_);
+        }
+        if (m_rxChannel_.acquired() && m_txChannel_.acquired())
+        {
+          restoreChannelPriority_(*rxChannel_(), m_rxPriority_);
+          restoreChannelPriority_(*txChannel_(), m_txPriority_);
+        }
+      }
+      if (m_crcEnabled_)
+      {
+        m_crcEnabled_ = false;
+        DmaSpi::crcOwner() = nullptr;
+      }
+      m_crcChannel_.release();
+#endif
+      m_rxChannel_.release();
+      m_txChannel_.release();
+    }
+
+#if defined(KINETISK)
+    /** \brief DCHPRI registers are byte-reversed within each group of four **/
+    static volatile uint8_t& channelPriorityRegister_(const uint8_t& channel)
+    {
+      return *(&DMA_DCHPRI3 + (channel ^ 3));
+    }
+
+    static uint8_t channelPriority_(const uint8_t& channel)
+    {
+      return channelPriorityRegister_(channel) & DMA_DCHPRI_CHPRI(0xF);
+    }
+
+    /** \brief The fixed priority of the channel's group. Chips with 16 channels only have one group.
+    **/
+    static uint8_t groupPriority_(const uint8_t& channel)
+    {
+#if DMA_NUM_CHANNELS > 16
+      return (channel < 16) ? ((DMA_CR & DMA_CR_GRP0PRI) ? 1 : 0) : ((DMA_CR & DMA_CR_GRP1PRI) ? 1 : 0);
+#else
+      (void)channel;
+      return 0;
+#endif
+    }
+
+    /** \brief Channels per priority group: 16, or all of them on chips with fewer channels (Teensy 3.0 has 4).
+    **/
+    static constexpr uint8_t groupSize_()
+    {
+      return (DMA_NUM_CHANNELS < 16) ? DMA_NUM_CHANNELS : 16;
+    }
+
+    static bool sameGroup_(const uint8_t& channel, const uint8_t& other)
+    {
+      return (channel & ~15) == (other & ~15);
+    }
+
+    /** \brief Give a channel a new priority (0 .. groupSize_() - 1). Priorities must be unique within a group,
+     * so the channel of that group that had this priority before gets the old priority of the channel in question.
+    **/
+    static void setChannelPriority_(const uint8_t& channel, const uint8_t& priority)
+    {
+      const uint8_t oldPriority = channelPriority_(channel);
+      if (oldPriority == priority)
+      {
+        return;
+      }
+      const uint8_t first = channel - (channel % groupSize_());
+      for (uint8_t other = first; other < first + groupSize_(); other++)
+      {
+        if ((other != channel) && (channelPriority_(other) == priority))
+        {
+          volatile uint8_t& reg = channelPriorityRegister_(other);
+          reg = (reg & ~DMA_DCHPRI_CHPRI(0xF)) | DMA_DCHPRI_CHPRI(oldPriority);
+          break;
+        }
+      }
+      volatile uint8_t& reg = channelPriorityRegister_(channel);
+      reg = (reg & ~DMA_DCHPRI_CHPRI(0xF)) | DMA_DCHPRI_CHPRI(priority);
+    }
+
+    /** \brief Set a channel's DCHPRI register back to a value saved before begin() changed it.
+    **/
+    static void restoreChannelPriority_(const DMAChannel& channel, const uint8_t& saved)
+    {
+      setChannelPriority_(channel.channel, saved & DMA_DCHPRI_CHPRI(0xF));
+      channelPriorityRegister_(channel.channel) = saved;
+    }
+
+    static void applyChannelOptions_(DMAChannel& channel, const DmaSpi::ChannelOptions& options)
+    {
+      if (options.priority >= 0)
+      {
+        const uint8_t maxPriority = groupSize_() - 1;
+        setChannelPriority_(channel.channel, (options.priority > maxPriority) ? maxPriority : options.priority);
+      }
+      volatile uint8_t& reg = channelPriorityRegister_(channel.channel);
+      reg = (reg & DMA_DCHPRI_CHPRI(0xF))
+        | (options.preemptible ? DMA_DCHPRI_ECP : 0)
+        | (options.canPreempt ? 0 : DMA_DCHPRI_DPA);
+      channel.TCD->CSR = (channel.TCD->CSR & ~DMA_TCD_CSR_BWC(3)) | DMA_TCD_CSR_BWC((uint8_t)options.bandwidth);
+    }
+
+    static DmaSpi::ChannelOptions readChannelOptions_(DMAChannel& channel)
+    {
+      const uint8_t reg = channelPriorityRegister_(channel.channel);
+      return DmaSpi::ChannelOptions(reg & DMA_DCHPRI_CHPRI(0xF),
+                                    (reg & DMA_DCHPRI_ECP) != 0,
+                                    (reg & DMA_DCHPRI_DPA) == 0,
+                                    (DmaSpi::Bandwidth)((channel.TCD->CSR >> 14) & 3));
+    }
+
+    static void applyOptions_(const DmaSpi::BusOptions& options)
+    {
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+      {
+        applyChannelOptions_(*txChannel_(), options.tx);
+        applyChannelOptions_(*rxChannel_(), options.rx);
+        keepRxAboveTx_();
+      }
+    }
+
+    /** \brief rx must outrank tx, swap their priorities if they say otherwise.
+     * In different groups, acquireDmaChannels() has already put rx into the higher priority group.
+    **/
+    static void keepRxAboveTx_()
     {
-      if (txChannel_() == nullptr)
+      const uint8_t txPriority = channelPriority_(txChannel_()->channel);
+      if (sameGroup_(rxChannel_()->channel, txChannel_()->channel)
+       && (channelPriority_(rxChannel_()->channel) < txPriority))
       {
+        setChannelPriority_(rxChannel_()->channel, txPriority);
+        DMASPI_PRINT(("  rx priority raised above tx\n"));
+      }
+    }
+
+    static DMAChannel* crcChannel_()
+    {
+      return m_crcChannel_.get();
+    }
+
+    static bool begin_setup_crcChannel_()
+    {
+      if (DmaSpi::crcOwner() != nullptr)
+      {
+        DMASPI_PRINT(("  CRC module is used by another DmaSpi\n"));
         return false;
       }
-      if (rxChannel_() == nullptr)
+      if ((m_crcChannel_.acquire() == nullptr) || crcChannel_()->error())
       {
-        delete txChannel_();
         return false;
       }
+      DmaSpi::crcOwner() = &init_count_;
+      m_crcPriority_ = channelPriorityRegister_(crcChannel_()->channel);
+      m_crcEnabled_ = true;
+      SIM_SCGC6 |= SIM_SCGC6_CRC;
+      crcChannel_()->disable();
+      crcChannel_()->destination((volatile uint8_t&)CRC_CRC);
+      crcChannel_()->disableOnCompletion();
+      crcChannel_()->attachInterrupt(crcIsr_);
+      crcChannel_()->interruptAtCompletion();
+      // The crc channel copies the whole sink in one minor loop. Make it the lowest priority of its group and
+      // preemptible, so it can't hold off the rx and tx channels (or other DMA users) for that long.
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+      {
+        setChannelPriority_(crcChannel_()->channel, 0);
+        volatile uint8_t& reg = channelPriorityRegister_(crcChannel_()->channel);
+        reg = (reg & DMA_DCHPRI_CHPRI(0xF)) | DMA_DCHPRI_ECP | DMA_DCHPRI_DPA;
+        // taking priority 0 may have displaced rx or tx
+        keepRxAboveTx_();
+      }
       return true;
     }
 
-    static void destroyDmaChannels()
+    /** \brief Prepare the CRC module and channel for the current Transfer.
+     *
+     * When the rx channel has received all data, it triggers the crc channel through a major loop link,
+     * which then copies the data sink to the CRC module in a single minor loop.
+     * The crc channel has the lowest priority and is preemptible, see begin_setup_crcChannel_().
+     * The crc channel's interrupt ends the Transfer.
+    **/
+    static void setupCrc_()
     {
-      if (rxChannel_() != nullptr)
+      const DmaSpi::Crc* pCrc = m_pCurrentTransfer->m_pCrc;
+      if (pCrc == nullptr)
+      {
+        return;
+      }
+      CRC_GPOLY = pCrc->polynomial;
+      const uint32_t ctrl = ((pCrc->width == 32) ? CRC_CTRL_TCRC : 0)
+        | CRC_CTRL_TOT(pCrc->reflectIn ? 1 : 0)
+        | CRC_CTRL_TOTR(pCrc->reflectOut ? 2 : 0)
+        | (pCrc->complement ? CRC_CTRL_FXOR : 0);
+      CRC_CTRL = ctrl | CRC_CTRL_WAS;
+      CRC_CRC = pCrc->seed;
+      CRC_CTRL = ctrl;
+
+      crcChannel_()->sourceBuffer(m_pCurrentTransfer->m_pDest, m_pCurrentTransfer->m_transferCount);
+      crcChannel_()->TCD->NBYTES = m_pCurrentTransfer->m_transferCount;
+      crcChannel_()->TCD->CITER = 1;
+      crcChannel_()->TCD->BITER = 1;
+      // The eDMA ignores MAJORELINK while DONE is set, and DONE is still set from the previous Transfer
+      rxChannel_()->clearComplete();
+      crcChannel_()->triggerAtCompletionOf(*rxChannel_());
+      rxChannel_()->TCD->CSR &= ~DMA_TCD_CSR_INTMAJOR;
+    }
+
+    static void crcIsr_()
+    {
+      if (!interruptPending_(crcChannel_()))
+      {
+        return;
+      }
+      m_isrTick_ = SYST_CVR;
+      DMASPI_PRINT(("DmaSpi::crcIsr_()\n"));
+      crcChannel_()->clearInterrupt();
+      if ((m_pCurrentTransfer == nullptr) || (m_pCurrentTransfer->m_pCrc == nullptr))
       {
-        delete rxChannel_();
+        // left over from an aborted Transfer
+        return;
       }
-      if (txChannel_() != nullptr)
+      const DmaSpi::Crc* pCrc = m_pCurrentTransfer->m_pCrc;
+      uint32_t crc = CRC_CRC;
+      if (pCrc->width == 16)
       {
-        delete txChannel_();
+        // reflecting the output transposes the whole register, which moves a 16 bit result to the upper half
+        crc = pCrc->reflectOut ? (crc >> 16) : (crc & 0xFFFF);
       }
+      m_pCurrentTransfer->m_crc = crc;
+      // unlink the crc channel and let the rx channel end Transfers again
+      rxChannel_()->TCD->CSR = (rxChannel_()->TCD->CSR & ~(DMA_TCD_CSR_MAJORELINK | DMA_TCD_CSR_DONE)) | DMA_TCD_CSR_INTMAJOR;
+      completeCurrentTransfer_();
+    }
+#elif defined(KINETISL)
+    static DmaSpi::ChannelOptions readChannelOptions_(DMAChannel& channel)
+    {
+      // fixed priority, channel 0 wins. No preemption, cycle steal mode.
+      return DmaSpi::ChannelOptions(DMA_NUM_CHANNELS - 1 - channel.channel, false, false, DmaSpi::Bandwidth::noStall);
+    }
+
+    static void applyOptions_(const DmaSpi::BusOptions&) {}
+
+    static bool begin_setup_crcChannel_()
+    {
+      DMASPI_PRINT(("  no CRC module\n"));
+      return false;
     }
 
+    static void setupCrc_() {}
+#endif // KINETISK else KINETISL
+
+    /** \brief the rx channel. Only valid between begin() and end(). **/
     static DMAChannel* rxChannel_()
     {
-      static DMAChannel* pChannel = new DMAChannel();
-      return pChannel;
+      return m_rxChannel_.get();
     }
 
+    /** \brief the tx channel. Only valid between begin() and end(). **/
     static DMAChannel* txChannel_()
     {
-      static DMAChannel* pChannel = new DMAChannel();
-      return pChannel;
+      return m_txChannel_.get();
     }
 
     static void rxIsr_()
     {
+      if (!interruptPending_(rxChannel_()))
+      {
+        // the interrupt was raised before the Transfer was aborted
+        return;
+      }
+      m_isrTick_ = SYST_CVR;
       DMASPI_PRINT(("DmaSpi::rxIsr_()\n"));
       rxChannel_()->clearInterrupt();
-      // end current transfer: deselect and mark as done
-      finishCurrentTransfer();
+      if (m_pStep_ != nullptr)
+      {
+        // a program step is done, continue with the next one
+        post_finishCurrentTransfer();
+        if (runProgram_())
+        {
+          return;
+        }
+      }
+      completeCurrentTransfer_();
+    }
+
+    /** \brief end the current transfer: deselect and mark as done, then continue according to the driver state
+    **/
+    static void completeCurrentTransfer_(const Transfer::State& state = Transfer::State::eDone)
+    {
+      finishCurrentTransfer(state);
 
       DMASPI_PRINT(("  state = "));
       switch(state_)
@@ -430,69 +1509,340 @@ class AbstractDmaSpi
     }
 
     static void pre_cs() {DMASPI_INSTANCE::pre_cs_impl();}
+    static void resume_cs() {DMASPI_INSTANCE::resume_cs_impl();}
     static void post_cs() {DMASPI_INSTANCE::post_cs_impl();}
 
-    static void beginPendingTransfer()
+    static void setupChannels_(const uint8_t* pSource, const uint16_t& transferCount, volatile uint8_t* pDest, const uint8_t fill, const bool& pattern = false)
     {
-      if (m_pNextTransfer == nullptr)
-      {
-        DMASPI_PRINT(("DmaSpi::beginNextTransfer: no pending transfer\n"));
-        return;
-      }
-
-      m_pCurrentTransfer = m_pNextTransfer;
-      DMASPI_PRINT(("DmaSpi::beginNextTransfer: starting transfer @ %p\n", m_pCurrentTransfer));
-      m_pCurrentTransfer->m_state = Transfer::State::inProgress;
-      m_pNextTransfer = m_pNextTransfer->m_pNext;
-      if (m_pNextTransfer == nullptr)
-      {
-        DMASPI_PRINT(("  this was the last in the queue\n"));
-        m_pLastTransfer = nullptr;
-      }
-
       // configure Rx DMA
-      if (m_pCurrentTransfer->m_pDest != nullptr)
+      if (pDest != nullptr)
       {
         // real data sink
         DMASPI_PRINT(("  real sink\n"));
-        rxChannel_()->destinationBuffer(m_pCurrentTransfer->m_pDest,
-                                        m_pCurrentTransfer->m_transferCount);
+        rxChannel_()->destinationBuffer(pDest, transferCount);
       }
       else
       {
         // dummy data sink
         DMASPI_PRINT(("  dummy sink\n"));
         rxChannel_()->destination(m_devNull);
-        rxChannel_()->transferCount(m_pCurrentTransfer->m_transferCount);
+        rxChannel_()->transferCount(transferCount);
       }
 
       // configure Tx DMA
-      if (m_pCurrentTransfer->m_pSource != nullptr)
+      if (pSource != nullptr)
       {
         // real data source
         DMASPI_PRINT(("  real source\n"));
-        txChannel_()->sourceBuffer(m_pCurrentTransfer->m_pSource,
-                                   m_pCurrentTransfer->m_transferCount);
+        txChannel_()->sourceBuffer(pSource, transferCount);
+        setPatternModulo_(false);
+      }
+      else if (pattern)
+      {
+        // repeating pattern: the source address wraps around in the pattern buffer
+        DMASPI_PRINT(("  pattern source\n"));
+        txChannel_()->sourceBuffer(m_pattern_, transferCount);
+        setPatternModulo_(true);
       }
       else
       {
         // dummy data source
         DMASPI_PRINT(("  dummy source\n"));
-        txChannel_()->source(m_pCurrentTransfer->m_fill);
-        txChannel_()->transferCount(m_pCurrentTransfer->m_transferCount);
+        // the channel keeps the address of its source, so the fill byte needs static storage
+        m_txFill_ = fill;
+        txChannel_()->source(m_txFill_);
+        txChannel_()->transferCount(transferCount);
+        setPatternModulo_(false);
+      }
+    }
+
+    /** \brief fill the pattern buffer with copies of a pattern whose length divides its size **/
+    static void loadPattern_(const uint8_t* pPattern, const uint8_t& length)
+    {
+      for (uint8_t i = 0; i < patternBufferSize_; i++)
+      {
+        m_pattern_[i] = pPattern[i % length];
+      }
+    }
+
+    /** \brief enable or disable the tx channel's source address modulo for the pattern buffer **/
+    static void setPatternModulo_(const bool& enable)
+    {
+#if defined(KINETISK)
+      // SMOD is in the upper bits of ATTR_SRC, the source size stays 8 bit
+      txChannel_()->TCD->ATTR_SRC = enable ? (DMA_TCD_ATTR_SMOD(4) >> 8) : 0;
+      if (enable)
+      {
+        txChannel_()->TCD->SLAST = 0;
       }
+#elif defined(KINETISL)
+      // SMOD 1: 16 byte buffer
+      txChannel_()->CFG->DCR = (txChannel_()->CFG->DCR & ~DMA_DCR_SMOD(15)) | (enable ? DMA_DCR_SMOD(1) : 0);
+#endif
+    }
+
+    /** \brief little endian 16 bit argument n of the current program step **/
+    static uint16_t stepArgument_(const uint8_t& n)
+    {
+      return m_pStep_[2 * n] | (m_pStep_[2 * n + 1] << 8);
+    }
 
+    /** \brief 32 bit pointer argument at the beginning of the current program step **/
+    static uintptr_t stepPointer_()
+    {
+      return stepArgument_(0) | ((uint32_t)stepArgument_(1) << 16);
+    }
+
+    /** \brief start sending count bytes of the pattern buffer while the chip is already selected **/
+    static void writePattern_(const uint16_t& count)
+    {
+      setupChannels_(nullptr, count, nullptr, 0, true);
       pre_cs();
+      resume_cs();
+      post_cs();
+    }
 
-      // Select Chip
-      if (m_pCurrentTransfer->m_pSelect != nullptr)
+    /** \brief start sending count bytes from pSource while the chip is already selected **/
+    static void writeSegment_(const uint8_t* pSource, const uint16_t& count)
+    {
+      setupChannels_(pSource, count, nullptr, 0);
+      pre_cs();
+      resume_cs();
+      post_cs();
+    }
+
+    /** \brief A delay step is over: continue the program. Interrupts must be disabled.
+    **/
+    static void endDelay_()
+    {
+      m_delayTimer_.end();
+      m_delaying_ = false;
+      if (!runProgram_())
       {
-        m_pCurrentTransfer->m_pSelect->select();
+        completeCurrentTransfer_();
       }
-      else
+    }
+
+    /** \brief Time the current Transfer's timeout with an IntervalTimer, if it has one.
+     * Without a free PIT channel, or for timeouts that are too long for one, service() checks the timeout instead.
+    **/
+    static void startWatchdog_()
+    {
+      const uint32_t timeout = m_pCurrentTransfer->m_timeout;
+      m_watchdogPolled_ = (timeout != 0)
+        && ((timeout > 0xFFFFFFFFUL / 1000) || !m_watchdogTimer_.begin(watchdogIsr_, timeout * 1000UL));
+    }
+
+    static void watchdogIsr_()
+    {
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
       {
-        m_Spi.beginTransaction(SPISettings());
+        m_watchdogTimer_.end();
+        if (m_pCurrentTransfer != nullptr)
+        {
+          DMASPI_PRINT(("DmaSpi::watchdogIsr_() : timeout of %p\n", m_pCurrentTransfer));
+          abortCurrentTransfer_(Transfer::State::timedOut);
+        }
+      }
+    }
+
+    static void delayIsr_()
+    {
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+      {
+        if (m_delaying_)
+        {
+          DMASPI_PRINT(("DmaSpi::delayIsr_()\n"));
+          endDelay_();
+        }
+      }
+    }
+
+    /** \brief Execute program steps until a write has been started, a delay begins or the program ends.
+     * \return true if the program is still running, false if it has ended.
+    **/
+    static bool runProgram_()
+    {
+      AbstractChipSelect* pSelect = m_pCurrentTransfer->m_pSelect;
+      for (;;)
+      {
+        if (m_rowsLeft_ != 0)
+        {
+          uint16_t rows = 1;
+          if (m_rowStride_ == m_rowLength_)
+          {
+            // contiguous rows: send as many as fit into one DMA transfer
+            rows = 0x7FFF / m_rowLength_;
+            if (rows > m_rowsLeft_)
+            {
+              rows = m_rowsLeft_;
+            }
+          }
+          writeSegment_(m_pRow_, rows * m_rowLength_);
+          m_pRow_ += rows * m_rowStride_;
+          m_rowsLeft_ -= rows;
+          return true;
+        }
+
+        if (m_fillLeft_ != 0)
+        {
+          // a multiple of the pattern buffer size, so the next part continues the pattern
+          const uint16_t count = (m_fillLeft_ > 0x7FF0) ? 0x7FF0 : m_fillLeft_;
+          writePattern_(count);
+          m_fillLeft_ -= count;
+          return true;
+        }
+
+        const uint8_t opcode = *m_pStep_++;
+        switch(opcode)
+        {
+          case DmaSpi::program::eSelect:
+            DMASPI_PRINT(("  program: select\n"));
+            select_();
+            break;
+
+          case DmaSpi::program::eDeselect:
+            DMASPI_PRINT(("  program: deselect\n"));
+            deselect_();
+            break;
+
+          case DmaSpi::program::eCommand:
+            DMASPI_PRINT(("  program: command\n"));
+            if (pSelect != nullptr)
+            {
+              pSelect->command();
+            }
+            break;
+
+          case DmaSpi::program::eData:
+            DMASPI_PRINT(("  program: data\n"));
+            if (pSelect != nullptr)
+            {
+              pSelect->data();
+            }
+            break;
+
+          case DmaSpi::program::eWrite:
+          {
+            const uint8_t count = *m_pStep_++;
+            DMASPI_PRINT(("  program: write %u\n", count));
+            writeSegment_(m_pStep_, count);
+            m_pStep_ += count;
+            return true;
+          }
+
+          case DmaSpi::program::eRead:
+          {
+            volatile uint8_t* pDest = (volatile uint8_t*)stepPointer_();
+            const uint16_t count = stepArgument_(2);
+            DMASPI_PRINT(("  program: read %u into %p\n", count, pDest));
+            m_pStep_ += 6;
+            setupChannels_(nullptr, count, pDest, 0xFF);
+            pre_cs();
+            resume_cs();
+            post_cs();
+            return true;
+          }
+
+          case DmaSpi::program::eWriteRows:
+          {
+            m_pRow_ = (const uint8_t*)stepPointer_();
+            m_rowLength_ = stepArgument_(2);
+            m_rowStride_ = stepArgument_(3);
+            m_rowsLeft_ = stepArgument_(4);
+            DMASPI_PRINT(("  program: write %u rows @ %p\n", m_rowsLeft_, m_pRow_));
+            m_pStep_ += 10;
+            break;
+          }
+
+          case DmaSpi::program::eFill:
+          {
+            const uint8_t length = *m_pStep_++;
+            loadPattern_(m_pStep_, length);
+            m_pStep_ += length;
+            m_fillLeft_ = stepArgument_(0) | ((uint32_t)stepArgument_(1) << 16);
+            DMASPI_PRINT(("  program: fill %lu\n", m_fillLeft_));
+            m_pStep_ += 4;
+            break;
+          }
+
+          case DmaSpi::program::eDelay:
+          {
+            const uint16_t ms = stepArgument_(0);
+            DMASPI_PRINT(("  program: delay %u\n", ms));
+            m_pStep_ += 2;
+            if (ms == 0)
+            {
+              break;
+            }
+            m_delaying_ = true;
+            m_delayPolled_ = !m_delayTimer_.begin(delayIsr_, ms * 1000UL);
+            if (m_delayPolled_)
+            {
+              DMASPI_PRINT(("  no timer, waiting for service()\n"));
+              // millis() may tick right after it was read, one more ms makes sure the delay is never too short
+              m_resumeAt_ = millis() + ms + 1;
+            }
+            return true;
+          }
+
+          case DmaSpi::program::eEnd:
+          default:
+            DMASPI_PRINT(("  program: end\n"));
+            m_pStep_ = nullptr;
+            return false;
+        }
       }
+    }
+
+    static void beginPendingTransfer()
+    {
+      if (m_pNextTransfer == nullptr)
+      {
+        DMASPI_PRINT(("DmaSpi::beginNextTransfer: no pending transfer\n"));
+        return;
+      }
+
+      m_pCurrentTransfer = m_pNextTransfer;
+      DMASPI_PRINT(("DmaSpi::beginNextTransfer: starting transfer @ %p\n", m_pCurrentTransfer));
+      m_pCurrentTransfer->m_state = Transfer::State::inProgress;
+      m_startedAt_ = millis();
+      startWatchdog_();
+      m_pNextTransfer = m_pNextTransfer->m_pNext;
+      if (m_pNextTransfer == nullptr)
+      {
+        DMASPI_PRINT(("  this was the last in the queue\n"));
+        m_pLastTransfer = nullptr;
+      }
+
+      if (m_pCurrentTransfer->m_pProgram != nullptr)
+      {
+        DMASPI_PRINT(("  running program\n"));
+        m_pStep_ = m_pCurrentTransfer->m_pProgram;
+        if (!runProgram_())
+        {
+          // nothing to send
+          completeCurrentTransfer_();
+        }
+        return;
+      }
+
+      const bool pattern = (m_pCurrentTransfer->m_pSource == nullptr) && (m_pCurrentTransfer->m_pPattern != nullptr);
+      if (pattern)
+      {
+        loadPattern_(m_pCurrentTransfer->m_pPattern, m_pCurrentTransfer->m_patternLength);
+      }
+      setupChannels_(m_pCurrentTransfer->m_pSource,
+                     m_pCurrentTransfer->m_transferCount,
+                     m_pCurrentTransfer->m_pDest,
+                     m_pCurrentTransfer->m_fill,
+                     pattern);
+      setupCrc_();
+
+      pre_cs();
+
+      // Select Chip
+      select_();
 
       post_cs();
     }
@@ -503,6 +1853,36 @@ class AbstractDmaSpi
     static Transfer* volatile m_pNextTransfer;
     static Transfer* volatile m_pLastTransfer;
     static volatile uint8_t m_devNull;
+    static const uint8_t* volatile m_pStep_;
+    static volatile bool m_selected_;
+    static volatile bool m_delaying_;
+    static volatile bool m_delayPolled_;
+    static volatile uint32_t m_resumeAt_;
+    static IntervalTimer m_delayTimer_;
+    static IntervalTimer m_watchdogTimer_;
+    static volatile bool m_watchdogPolled_;
+    static bool m_crcEnabled_;
+#if defined(KINETISK)
+    static uint8_t m_rxPriority_;
+    static uint8_t m_txPriority_;
+    static uint8_t m_crcPriority_;
+#endif
+    static volatile uint32_t m_isrTick_;
+    static volatile uint32_t m_startedAt_;
+    static volatile uint32_t m_wakeLatency_;
+    static DmaSpi::ChannelStorage m_rxChannel_;
+    static DmaSpi::ChannelStorage m_txChannel_;
+#if defined(KINETISK)
+    static DmaSpi::ChannelStorage m_crcChannel_;
+#endif
+    static const uint8_t* volatile m_pRow_;
+    static volatile uint16_t m_rowLength_;
+    static volatile uint16_t m_rowStride_;
+    static volatile uint16_t m_rowsLeft_;
+    static volatile uint32_t m_fillLeft_;
+    static volatile uint8_t m_txFill_;
+    static const uint8_t patternBufferSize_ = 16;
+    alignas(16) static uint8_t m_pattern_[patternBufferSize_];
     //static SPICLASS& m_Spi;
 };
 
@@ -524,6 +1904,85 @@ typename AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::Transfer* volatile Ab
 template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
 volatile uint8_t AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_devNull = 0;
 
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+const uint8_t* volatile AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_pStep_ = nullptr;
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+volatile bool AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_selected_ = false;
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+volatile bool AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_delaying_ = false;
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+volatile bool AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_delayPolled_ = false;
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+volatile uint32_t AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_resumeAt_ = 0;
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+IntervalTimer AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_delayTimer_;
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+IntervalTimer AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_watchdogTimer_;
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+volatile bool AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_watchdogPolled_ = false;
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+bool AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_crcEnabled_ = false;
+
+#if defined(KINETISK)
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+uint8_t AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_rxPriority_ = 0;
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+uint8_t AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_txPriority_ = 0;
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+uint8_t AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_crcPriority_ = 0;
+#endif
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+volatile uint32_t AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_isrTick_ = 0;
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+volatile uint32_t AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_wakeLatency_ = 0;
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+volatile uint32_t AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_startedAt_ = 0;
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+DmaSpi::ChannelStorage AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_rxChannel_;
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+DmaSpi::ChannelStorage AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_txChannel_;
+
+#if defined(KINETISK)
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+DmaSpi::ChannelStorage AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_crcChannel_;
+#endif
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+const uint8_t* volatile AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_pRow_ = nullptr;
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+volatile uint16_t AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_rowLength_ = 0;
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+volatile uint16_t AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_rowStride_ = 0;
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+volatile uint16_t AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_rowsLeft_ = 0;
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+volatile uint32_t AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_fillLeft_ = 0;
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+volatile uint8_t AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_txFill_ = 0;
+
+template<typename DMASPI_INSTANCE, typename SPICLASS, SPICLASS& m_Spi>
+alignas(16) uint8_t AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::m_pattern_[AbstractDmaSpi<DMASPI_INSTANCE, SPICLASS, m_Spi>::patternBufferSize_];
+
 #if defined(KINETISK)
 
 class DmaSpi0 : public AbstractDmaSpi<DmaSpi0, SPIClass, SPI>
@@ -553,6 +2012,8 @@ public:
     SPI0_RSER = SPI_RSER_RFDF_RE | SPI_RSER_RFDF_DIRS | SPI_RSER_TFFF_RE | SPI_RSER_TFFF_DIRS;
   }
 
+  static void resume_cs_impl() {}
+
   static void post_cs_impl()
   {
     rxChannel_()->enable();
@@ -565,6 +2026,17 @@ public:
     SPI0_SR = 0xFF0F0000;
   }
 
+  static void abort_impl()
+  {
+    // Halting stops at the next frame boundary. Flushing earlier would let a frame that is still shifting
+    // put its byte into the RX FIFO, where the next Transfer would take it as its first byte.
+    SPI0_MCR |= SPI_MCR_HALT;
+    while (SPI0_SR & SPI_SR_TXRXS)
+    {
+    }
+    SPI0_MCR = (SPI0_MCR & ~SPI_MCR_HALT) | SPI_MCR_CLR_TXF | SPI_MCR_CLR_RXF;
+  }
+
 private:
 };
 
@@ -599,6 +2071,8 @@ public:
     SPI1_RSER = SPI_RSER_RFDF_RE | SPI_RSER_RFDF_DIRS | SPI_RSER_TFFF_RE | SPI_RSER_TFFF_DIRS;
   }
 
+  static void resume_cs_impl() {}
+
   static void post_cs_impl()
   {
     rxChannel_()->enable();
@@ -611,6 +2085,17 @@ public:
     SPI1_SR = 0xFF0F0000;
   }
 
+  static void abort_impl()
+  {
+    // Halting stops at the next frame boundary. Flushing earlier would let a frame that is still shifting
+    // put its byte into the RX FIFO, where the next Transfer would take it as its first byte.
+    SPI1_MCR |= SPI_MCR_HALT;
+    while (SPI1_SR & SPI_SR_TXRXS)
+    {
+    }
+    SPI1_MCR = (SPI1_MCR & ~SPI_MCR_HALT) | SPI_MCR_CLR_TXF | SPI_MCR_CLR_RXF;
+  }
+
 private:
 };
 
@@ -642,6 +2127,8 @@ public:
     SPI2_RSER = SPI_RSER_RFDF_RE | SPI_RSER_RFDF_DIRS | SPI_RSER_TFFF_RE | SPI_RSER_TFFF_DIRS;
   }
 
+  static void resume_cs_impl() {}
+
   static void post_cs_impl()
   {
     rxChannel_()->enable();
@@ -654,6 +2141,17 @@ public:
     SPI2_SR = 0xFF0F0000;
   }
 
+  static void abort_impl()
+  {
+    // Halting stops at the next frame boundary. Flushing earlier would let a frame that is still shifting
+    // put its byte into the RX FIFO, where the next Transfer would take it as its first byte.
+    SPI2_MCR |= SPI_MCR_HALT;
+    while (SPI2_SR & SPI_SR_TXRXS)
+    {
+    }
+    SPI2_MCR = (SPI2_MCR & ~SPI_MCR_HALT) | SPI_MCR_CLR_TXF | SPI_MCR_CLR_RXF;
+  }
+
 private:
 };
 */
@@ -691,6 +2189,12 @@ public:
     SPI0_C2 |= SPI_C2_TXDMAE | SPI_C2_RXDMAE;
   }
 
+  static void resume_cs_impl()
+  {
+    // the chip is already selected, so the SPI won't be enabled by a transaction: do it here
+    SPI0_C1 |= SPI_C1_SPE;
+  }
+
   static void post_cs_impl()
   {
     rxChannel_()->enable();
@@ -704,6 +2208,23 @@ public:
     rxChannel_()->clearComplete();
   }
 
+  static void abort_impl()
+  {
+    // Let a byte that is still shifting finish, otherwise it would be the next Transfer's first byte.
+    // Once the transmit buffer is empty, at most one frame is left. Reading the status and data registers clears a received byte.
+    while (!(SPI0_S & SPI_S_SPTEF))
+    {
+    }
+    (void)SPI0_S;
+    (void)SPI0_DL;
+    const uint32_t start = micros();
+    while (!(SPI0_S & SPI_S_SPRF) && (micros() - start < abortFrameTimeout_))
+    {
+    }
+    (void)SPI0_S;
+    (void)SPI0_DL;
+  }
+
 private:
 };
 
@@ -735,6 +2256,12 @@ public:
     SPI1_C2 |= SPI_C2_TXDMAE | SPI_C2_RXDMAE;
   }
 
+  static void resume_cs_impl()
+  {
+    // the chip is already selected, so the SPI won't be enabled by a transaction: do it here
+    SPI1_C1 |= SPI_C1_SPE;
+  }
+
 //  static void dumpCFG(const char *sz, uint32_t* p)
 //  {
 //    DMASPI_PRINT(("%s: %x %x %x %x \n", sz, p[0], p[1], p[2], p[3]));
@@ -755,6 +2282,23 @@ public:
     txChannel_()->clearComplete();
     rxChannel_()->clearComplete();
   }
+
+  static void abort_impl()
+  {
+    // Let a byte that is still shifting finish, otherwise it would be the next Transfer's first byte.
+    // Once the transmit buffer is empty, at most one frame is left. Reading the status and data registers clears a received byte.
+    while (!(SPI1_S & SPI_S_SPTEF))
+    {
+    }
+    (void)SPI1_S;
+    (void)SPI1_DL;
+    const uint32_t start = micros();
+    while (!(SPI1_S & SPI_S_SPRF) && (micros() - start < abortFrameTimeout_))
+    {
+    }
+    (void)SPI1_S;
+    (void)SPI1_DL;
+  }
 private:
 };
 
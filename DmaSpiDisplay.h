@@ -0,0 +1,189 @@
+#ifndef DMASPIDISPLAY_H
+#define DMASPIDISPLAY_H
+
+#include "DmaSpi.h"
+
+namespace DmaSpi
+{
+  /** \brief A rectangle of pixels in panel coordinates.
+  **/
+  struct Rect
+  {
+    Rect(const uint16_t& x_ = 0,
+         const uint16_t& y_ = 0,
+         const uint16_t& width_ = 0,
+         const uint16_t& height_ = 0)
+      : x(x_),
+      y(y_),
+      width(width_),
+      height(height_)
+    {}
+
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+  };
+
+  /** \brief Pushes dirty rectangles of a framebuffer to an ILI9341/ST7789 style TFT panel.
+   *
+   * For each rectangle, the column and page address window is set (CASET, PASET) and a memory write (RAMWR)
+   * sends the rectangle's pixels straight from the framebuffer. All rectangles of one push() form a single
+   * Transfer program, so the CPU only writes a few program bytes per rectangle and never copies pixels.
+   *
+   * The chip select must drive the panel's DC line, e.g. ActiveLowChipSelectDC.
+   * The framebuffer holds 16 bit pixels in the byte order the panel expects (RGB565, high byte first),
+   * i.e. byte-swapped compared to a plain uint16_t on the Teensy.
+   * Panel initialization is not handled here, a Transfer program in flash is a good fit for that.
+   *
+   * \tparam DMASPI the DmaSpi to use, e.g. DmaSpi0
+   * \tparam MAX_RECTS the maximum number of rectangles per push()
+  **/
+  template<typename DMASPI, size_t MAX_RECTS = 8>
+  class Display
+  {
+    public:
+      /** \brief Creates a display.
+      * \param cs the panel's chip select object, including the DC line
+      * \param pFramebuffer width * height pixels, row by row. It must remain valid while the display is in use.
+      * \param width the panel width in pixels
+      * \param height the panel height in pixels
+      **/
+      Display(AbstractChipSelect& cs,
+              const uint16_t* pFramebuffer,
+              const uint16_t& width,
+              const uint16_t& height)
+        : m_builder(m_program, sizeof(m_program)),
+        m_transfer(Program(m_program), &cs),
+        m_pFramebuffer(pFramebuffer),
+        m_width(width),
+        m_height(height)
+      {}
+
+      /** \brief Send the given rectangles of the framebuffer to the panel.
+      *
+      * Rectangles are clipped to the panel, empty ones are skipped.
+      * The framebuffer contents of these rectangles must not change until done() returns true.
+      * \return false if the previous push is still busy or there are more than MAX_RECTS rectangles, true otherwise.
+      **/
+      bool push(const Rect* pRects, const size_t& count)
+      {
+        if (m_transfer.busy() || (count > MAX_RECTS))
+        {
+          return false;
+        }
+        m_builder.clear();
+        m_builder.select();
+        for (size_t i = 0; i < count; i++)
+        {
+          addRect_(pRects[i]);
+        }
+        m_builder.deselect().end();
+        return m_builder.ok() && DMASPI::registerTransfer(m_transfer);
+      }
+
+      /** \brief Fill a rectangle on the panel with one colour, without touching the framebuffer.
+      *
+      * The colour is repeated by the DMA, so no pixel buffer is needed however large the rectangle is.
+      * \param colour RGB565 in the byte order of the framebuffer
+      * \return false if the previous push is still busy, true otherwise.
+      **/
+      bool fill(const Rect& rect, const uint16_t& colour)
+      {
+        if (m_transfer.busy())
+        {
+          return false;
+        }
+        m_builder.clear();
+        m_builder.select();
+        Rect clipped;
+        if (clip_(rect, clipped))
+        {
+          startWrite_(clipped);
+          m_builder.fill(&colour, sizeof(colour), (uint32_t)clipped.width * clipped.height * sizeof(uint16_t));
+        }
+        m_builder.deselect().end();
+        return m_builder.ok() && DMASPI::registerTransfer(m_transfer);
+      }
+
+      /** \brief Send the whole framebuffer to the panel.
+      **/
+      bool pushAll()
+      {
+        const Rect all(0, 0, m_width, m_height);
+        return push(&all, 1);
+      }
+
+      /** \brief Check if a push is still busy. **/
+      bool busy() const {return m_transfer.busy();}
+
+      /** \brief Check if the last push is done. **/
+      bool done() const {return m_transfer.done();}
+
+      uint16_t width() const {return m_width;}
+      uint16_t height() const {return m_height;}
+
+    private:
+      enum Command : uint8_t
+      {
+        eColumnAddressSet = 0x2A,
+        ePageAddressSet = 0x2B,
+        eMemoryWrite = 0x2C
+      };
+
+      /** \brief command, data and write steps for the window commands, RAMWR and the pixel rows **/
+      static const size_t programBytesPerRect = 2 * (1 + 3 + 1 + 6) + (1 + 3) + 1 + 11;
+
+      void setWindow_(const uint8_t& command, const uint16_t& first, const uint16_t& last)
+      {
+        const uint8_t args[] = {(uint8_t)(first >> 8), (uint8_t)first, (uint8_t)(last >> 8), (uint8_t)last};
+        m_builder.command().write(command).data().write(args, sizeof(args));
+      }
+
+      /** \brief clip a rectangle to the panel
+      * \return false if nothing is left of it
+      **/
+      bool clip_(const Rect& rect, Rect& clipped) const
+      {
+        if ((rect.x >= m_width) || (rect.y >= m_height) || (rect.width == 0) || (rect.height == 0))
+        {
+          return false;
+        }
+        clipped = rect;
+        clipped.width = ((uint32_t)rect.x + rect.width > m_width) ? (m_width - rect.x) : rect.width;
+        clipped.height = ((uint32_t)rect.y + rect.height > m_height) ? (m_height - rect.y) : rect.height;
+        return true;
+      }
+
+      /** \brief set the address window to a clipped rectangle and start a memory write **/
+      void startWrite_(const Rect& rect)
+      {
+        setWindow_(eColumnAddressSet, rect.x, rect.x + rect.width - 1);
+        setWindow_(ePageAddressSet, rect.y, rect.y + rect.height - 1);
+        m_builder.command().write(eMemoryWrite).data();
+      }
+
+      void addRect_(const Rect& rect)
+      {
+        Rect clipped;
+        if (!clip_(rect, clipped))
+        {
+          return;
+        }
+        startWrite_(clipped);
+        m_builder.writeRows(m_pFramebuffer + (uint32_t)clipped.y * m_width + clipped.x,
+                            clipped.width * sizeof(uint16_t),
+                            m_width * sizeof(uint16_t),
+                            clipped.height);
+      }
+
+      uint8_t m_program[MAX_RECTS * programBytesPerRect + 3];
+      program::Builder m_builder;
+      Transfer m_transfer;
+      const uint16_t* m_pFramebuffer;
+      const uint16_t m_width;
+      const uint16_t m_height;
+  };
+} // namespace DmaSpi
+
+#endif // DMASPIDISPLAY_H
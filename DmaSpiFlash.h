@@ -0,0 +1,343 @@
+#ifndef DMASPIFLASH_H
+#define DMASPIFLASH_H
+
+#include "DmaSpi.h"
+
+namespace DmaSpi
+{
+  /** \brief Block device for SPI NOR flash chips (W25Qxx and similar) with a small block cache.
+   *
+   * - read() returns a pointer into an LRU block cache. A miss is loaded by a single fast read command.
+   * - When blocks are read sequentially, the following READ_AHEAD blocks are fetched in the background while the
+   *   caller consumes the current one. Adjacent blocks are fetched by one fast read that scatters into free cache slots.
+   * - write() only updates the cache (write-back). flush() writes the dirty blocks back in address order,
+   *   each page program is sent straight from the cache. NOR flash can't overwrite data,
+   *   so eraseSector() the area before writing to it.
+   *
+   * Everything is done by Transfer programs on one Transfer. Calls that need a result wait for it,
+   * so the DmaSpi must be running. The chip must use 3 byte addresses (up to 16 MByte).
+   *
+   * \tparam DMASPI the DmaSpi to use, e.g. DmaSpi0
+   * \tparam BLOCK_SIZE bytes per block, a multiple of the page size (256) that divides the sector size (4096)
+   * \tparam CACHE_BLOCKS number of cached blocks
+   * \tparam READ_AHEAD maximum number of blocks to read ahead, less than CACHE_BLOCKS
+  **/
+  template<typename DMASPI, size_t BLOCK_SIZE = 512, size_t CACHE_BLOCKS = 4, size_t READ_AHEAD = 2>
+  class NorFlash
+  {
+    static_assert((BLOCK_SIZE % 256 == 0) && (4096 % BLOCK_SIZE == 0), "BLOCK_SIZE must be a multiple of 256 that divides 4096");
+    static_assert(READ_AHEAD < CACHE_BLOCKS, "READ_AHEAD must be less than CACHE_BLOCKS");
+
+    public:
+      static const size_t pageSize = 256;
+      static const size_t sectorSize = 4096;
+      static const size_t blockSize = BLOCK_SIZE;
+
+      /** \brief Creates a block device.
+      * \param cs the flash chip's chip select object
+      **/
+      NorFlash(AbstractChipSelect& cs)
+        : m_builder(m_program, sizeof(m_program)),
+        m_transfer(Program(m_program), &cs),
+        m_useCount(0),
+        m_nextBlock(0),
+        m_status(0)
+      {
+        for (size_t i = 0; i < CACHE_BLOCKS; i++)
+        {
+          m_slots[i].state = eEmpty;
+        }
+      }
+
+      /** \brief Read a block.
+      * \return a pointer to the block's data in the cache. It remains valid until the next call to read(), write() or eraseSector().
+      **/
+      const uint8_t* read(const uint32_t& block)
+      {
+        Slot* pSlot = find_(block);
+        if ((pSlot == nullptr) || (pSlot->state == eLoading))
+        {
+          wait_();
+          pSlot = find_(block);
+        }
+        if (pSlot == nullptr)
+        {
+          pSlot = allocate_();
+          pSlot->block = block;
+          pSlot->state = eLoading;
+          m_builder.clear();
+          readCommand_(block).read(pSlot->data, BLOCK_SIZE).deselect();
+          run_();
+          wait_();
+        }
+        touch_(pSlot);
+        if (block == m_nextBlock)
+        {
+          // sequential access
+          readAhead_(block + 1);
+        }
+        m_nextBlock = block + 1;
+        return (const uint8_t*)pSlot->data;
+      }
+
+      /** \brief Write a block. The data is copied into the cache and written to the chip by flush() or when the block is evicted.
+      **/
+      void write(const uint32_t& block, const uint8_t* pSource)
+      {
+        Slot* pSlot = find_(block);
+        if ((pSlot != nullptr) && (pSlot->state == eLoading))
+        {
+          wait_();
+        }
+        if (pSlot == nullptr)
+        {
+          wait_();
+          pSlot = allocate_();
+          pSlot->block = block;
+        }
+        memcpy((void*)pSlot->data, pSource, BLOCK_SIZE);
+        pSlot->state = eDirty;
+        touch_(pSlot);
+      }
+
+      /** \brief Write all dirty blocks to the chip, in address order.
+      **/
+      void flush()
+      {
+        wait_();
+        for (;;)
+        {
+          Slot* pFirst = nullptr;
+          for (size_t i = 0; i < CACHE_BLOCKS; i++)
+          {
+            if ((m_slots[i].state == eDirty) && ((pFirst == nullptr) || (m_slots[i].block < pFirst->block)))
+            {
+              pFirst = &m_slots[i];
+            }
+          }
+          if (pFirst == nullptr)
+          {
+            return;
+          }
+          writeBack_(*pFirst);
+        }
+      }
+
+      /** \brief Erase the 4 kByte sector that contains the given block. Cached blocks of that sector are dropped, even if dirty.
+      **/
+      void eraseSector(const uint32_t& block)
+      {
+        wait_();
+        const uint32_t address = (block * BLOCK_SIZE) & ~(sectorSize - 1);
+        for (size_t i = 0; i < CACHE_BLOCKS; i++)
+        {
+          if ((m_slots[i].state != eEmpty) && (((m_slots[i].block * BLOCK_SIZE) & ~(sectorSize - 1)) == address))
+          {
+            m_slots[i].state = eEmpty;
+          }
+        }
+        const uint8_t command[] = {eSectorErase, (uint8_t)(address >> 16), (uint8_t)(address >> 8), (uint8_t)address};
+        m_builder.clear();
+        m_builder.select().write(eWriteEnable).deselect()
+          .select().write(command, sizeof(command)).deselect();
+        run_();
+        waitReady_();
+      }
+
+    private:
+      enum Command : uint8_t
+      {
+        ePageProgram = 0x02,
+        eReadStatus = 0x05,
+        eWriteEnable = 0x06,
+        eFastRead = 0x0B,
+        eSectorErase = 0x20
+      };
+
+      enum SlotState : uint8_t
+      {
+        eEmpty,
+        eLoading,
+        eClean,
+        eDirty
+      };
+
+      struct Slot
+      {
+        uint32_t block;
+        uint32_t lastUse;
+        volatile SlotState state;
+        volatile uint8_t data[BLOCK_SIZE];
+      };
+
+      /** \brief the largest program is a read ahead (select, fast read command, one read per block, deselect, end) **/
+      static const size_t programSize = (10 + 7 * READ_AHEAD > 25) ? (10 + 7 * READ_AHEAD) : 25;
+
+      Slot* find_(const uint32_t& block)
+      {
+        for (size_t i = 0; i < CACHE_BLOCKS; i++)
+        {
+          if ((m_slots[i].state != eEmpty) && (m_slots[i].block == block))
+          {
+            return &m_slots[i];
+          }
+        }
+        return nullptr;
+      }
+
+      void touch_(Slot* pSlot)
+      {
+        pSlot->lastUse = ++m_useCount;
+      }
+
+      /** \brief the least recently used slot that is neither loading nor, if clean is true, dirty.
+       * Slots of the blocks first .. first + keep - 1 are kept as well.
+      **/
+      Slot* victim_(const bool& clean, const uint32_t& first = 0, const uint32_t& keep = 0)
+      {
+        Slot* pVictim = nullptr;
+        for (size_t i = 0; i < CACHE_BLOCKS; i++)
+        {
+          Slot& slot = m_slots[i];
+          if (slot.state == eEmpty)
+          {
+            return &slot;
+          }
+          if ((slot.state == eLoading) || (clean && (slot.state == eDirty)) || (slot.block - first < keep))
+          {
+            continue;
+          }
+          if ((pVictim == nullptr) || ((int32_t)(slot.lastUse - pVictim->lastUse) < 0))
+          {
+            pVictim = &slot;
+          }
+        }
+        return pVictim;
+      }
+
+      /** \brief get a slot for a new block, writing back its old contents if necessary. The bus must be idle. **/
+      Slot* allocate_()
+      {
+        Slot* pSlot = victim_(false);
+        if (pSlot->state == eDirty)
+        {
+          writeBack_(*pSlot);
+        }
+        pSlot->state = eEmpty;
+        return pSlot;
+      }
+
+      program::Builder& readCommand_(const uint32_t& block)
+      {
+        const uint32_t address = block * BLOCK_SIZE;
+        const uint8_t command[] = {eFastRead, (uint8_t)(address >> 16), (uint8_t)(address >> 8), (uint8_t)address, 0};
+        return m_builder.select().write(command, sizeof(command));
+      }
+
+      /** \brief start fetching the blocks up to READ_AHEAD blocks after the current one that aren't cached yet,
+       * once at most half of them are left
+      **/
+      void readAhead_(const uint32_t& first)
+      {
+        if (m_transfer.busy())
+        {
+          return;
+        }
+        uint32_t block = first;
+        while ((block < first + READ_AHEAD) && (find_(block) != nullptr))
+        {
+          block++;
+        }
+        const uint32_t ahead = block - first;
+        if ((ahead != 0) && (2 * ahead >= READ_AHEAD))
+        {
+          // enough blocks left, wait until a larger read ahead can be done with one command
+          return;
+        }
+        size_t count = 0;
+        while ((block + count < first + READ_AHEAD) && (find_(block + count) == nullptr))
+        {
+          // don't evict dirty blocks for a read ahead, that would need a synchronous write,
+          // nor blocks that were read ahead before and haven't been consumed yet
+          Slot* pSlot = victim_(true, first, READ_AHEAD);
+          if ((pSlot == nullptr) || ((pSlot->state != eEmpty) && (pSlot->lastUse == m_useCount)))
+          {
+            break;
+          }
+          if (count == 0)
+          {
+            m_builder.clear();
+            readCommand_(block);
+          }
+          pSlot->block = block + count;
+          pSlot->state = eLoading;
+          pSlot->lastUse = m_useCount;
+          m_builder.read(pSlot->data, BLOCK_SIZE);
+          count++;
+        }
+        if (count != 0)
+        {
+          m_builder.deselect();
+          run_();
+        }
+      }
+
+      /** \brief write a dirty block back, page by page. The bus must be idle. **/
+      void writeBack_(Slot& slot)
+      {
+        for (size_t offset = 0; offset < BLOCK_SIZE; offset += pageSize)
+        {
+          const uint32_t address = slot.block * BLOCK_SIZE + offset;
+          const uint8_t command[] = {ePageProgram, (uint8_t)(address >> 16), (uint8_t)(address >> 8), (uint8_t)address};
+          m_builder.clear();
+          m_builder.select().write(eWriteEnable).deselect()
+            .select().write(command, sizeof(command)).writeRows((const uint8_t*)slot.data + offset, pageSize, pageSize, 1).deselect();
+          run_();
+          waitReady_();
+        }
+        slot.state = eClean;
+      }
+
+      void run_()
+      {
+        m_builder.end();
+        DMASPI::registerTransfer(m_transfer);
+      }
+
+      /** \brief wait until the Transfer is done and mark loaded blocks as clean, or as empty if it was cancelled **/
+      void wait_()
+      {
+        const SlotState loaded = DMASPI::wait(m_transfer) ? eClean : eEmpty;
+        for (size_t i = 0; i < CACHE_BLOCKS; i++)
+        {
+          if (m_slots[i].state == eLoading)
+          {
+            m_slots[i].state = loaded;
+          }
+        }
+      }
+
+      /** \brief wait until the chip has finished a program or erase operation **/
+      void waitReady_()
+      {
+        do
+        {
+          wait_();
+          m_builder.clear();
+          m_builder.select().write(eReadStatus).read(&m_status, 1).deselect();
+          run_();
+          wait_();
+        } while (m_status & 0x01); // WIP: write in progress
+      }
+
+      Slot m_slots[CACHE_BLOCKS];
+      uint8_t m_program[programSize];
+      program::Builder m_builder;
+      Transfer m_transfer;
+      uint32_t m_useCount;
+      uint32_t m_nextBlock;
+      volatile uint8_t m_status;
+  };
+} // namespace DmaSpi
+
+#endif // DMASPIFLASH_H
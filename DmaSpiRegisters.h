@@ -0,0 +1,260 @@
+#ifndef DMASPIREGISTERS_H
+#define DMASPIREGISTERS_H
+
+#include "DmaSpi.h"
+
+namespace DmaSpi
+{
+  /** \brief How a device encodes the register address byte.
+   *
+   * The address byte is <tt>(reg & addressMask) | flag</tt>, where flag is readFlag or writeFlag,
+   * plus burstFlag if more than one register is accessed.
+  **/
+  struct RegisterFormat
+  {
+    constexpr RegisterFormat(const uint8_t& addressMask_,
+                             const uint8_t& readFlag_,
+                             const uint8_t& writeFlag_,
+                             const uint8_t& burstFlag_)
+      : addressMask(addressMask_),
+      readFlag(readFlag_),
+      writeFlag(writeFlag_),
+      burstFlag(burstFlag_)
+    {}
+
+    uint8_t addressMask;
+    uint8_t readFlag;
+    uint8_t writeFlag;
+    uint8_t burstFlag;
+  };
+
+  /** \brief Bit 7 set for reads, the address auto-increments in bursts (InvenSense, Bosch and many others) **/
+  constexpr RegisterFormat readBit7(0x7F, 0x80, 0x00, 0x00);
+  /** \brief Bit 7 set for reads, bit 6 set for auto-increment (ST accelerometers and gyroscopes) **/
+  constexpr RegisterFormat readBit7IncrementBit6(0x3F, 0x80, 0x00, 0x40);
+
+  /** \brief A device with registers on the SPI bus.
+  **/
+  struct RegisterDevice
+  {
+    RegisterDevice(AbstractChipSelect& cs_, const RegisterFormat& format_ = readBit7)
+      : cs(cs_),
+      format(format_)
+    {}
+
+    AbstractChipSelect& cs;
+    RegisterFormat format;
+  };
+
+  /** \brief Gathers register reads and writes, possibly for several devices, into one batch that is queued at once.
+   *
+   * Each access selects its device, sends the encoded address byte and then writes the data or reads into the
+   * caller's variable. The accesses are pre-encoded as Transfer programs in one buffer, one Transfer per run of
+   * accesses to the same device, so submit() is the only call per batch and read results are placed straight into the
+   * destination variables by the DMA. A batch can be submitted again whenever it is done, e.g. to poll a set of sensors.
+   * Received bytes are stored in the order the device sends them.
+   *
+   * Program bytes per access: 12 for a read, 5 + count for a write, plus one per run of accesses to the same device.
+   *
+   * \tparam DMASPI the DmaSpi to use, e.g. DmaSpi0
+   * \tparam PROGRAM_SIZE the size of the program buffer in bytes
+   * \tparam MAX_RUNS the maximum number of runs of accesses to the same device
+  **/
+  template<typename DMASPI, size_t PROGRAM_SIZE = 128, size_t MAX_RUNS = 4>
+  class RegisterBatch
+  {
+    public:
+      /** \brief the maximum number of bytes per write access **/
+      static const uint8_t maxWriteCount = 32;
+
+      RegisterBatch()
+        : m_builder(m_program, PROGRAM_SIZE),
+        m_pDevice(nullptr),
+        m_used(0),
+        m_runs(0),
+        m_open(true),
+        m_ok(true)
+      {}
+
+      /** \brief Start over with an empty batch.
+      * \return false if the batch is still busy and was not cleared.
+      **/
+      bool clear()
+      {
+        if (busy())
+        {
+          return false;
+        }
+        m_builder = program::Builder(m_program, PROGRAM_SIZE);
+        m_pDevice = nullptr;
+        m_used = 0;
+        m_runs = 0;
+        m_open = true;
+        m_ok = true;
+        return true;
+      }
+
+      /** \brief Add a read access.
+      * \param device the device to read from
+      * \param reg the first register
+      * \param pDest where to put the register contents. It must remain valid while the batch is in use.
+      * \param count number of registers to read (1..32767)
+      **/
+      RegisterBatch& read(const RegisterDevice& device, const uint8_t& reg, volatile void* pDest, const uint16_t& count = 1)
+      {
+        if ((count == 0) || (count >= 0x8000) || !beginAccess_(device))
+        {
+          m_ok = false;
+          return *this;
+        }
+        const RegisterFormat& format = device.format;
+        m_builder.select()
+          .write((uint8_t)((reg & format.addressMask) | format.readFlag | ((count > 1) ? format.burstFlag : 0)))
+          .read(pDest, count)
+          .deselect();
+        return *this;
+      }
+
+      /** \brief Add a write access. The data is copied into the batch.
+      * \param device the device to write to
+      * \param reg the first register
+      * \param pData the register contents
+      * \param count number of registers to write (1..maxWriteCount)
+      **/
+      RegisterBatch& write(const RegisterDevice& device, const uint8_t& reg, const void* pData, const uint8_t& count)
+      {
+        if ((count == 0) || (count > maxWriteCount) || !beginAccess_(device))
+        {
+          m_ok = false;
+          return *this;
+        }
+        const RegisterFormat& format = device.format;
+        uint8_t bytes[1 + maxWriteCount];
+        bytes[0] = (reg & format.addressMask) | format.writeFlag | ((count > 1) ? format.burstFlag : 0);
+        memcpy(bytes + 1, pData, count);
+        m_builder.select().write(bytes, 1 + count).deselect();
+        return *this;
+      }
+
+      RegisterBatch& write(const RegisterDevice& device, const uint8_t& reg, const uint8_t& value)
+      {
+        return write(device, reg, &value, 1);
+      }
+
+      /** \brief true if all accesses were valid and fit into the batch **/
+      bool ok() const {return m_ok && m_builder.ok();}
+
+      /** \brief Queue the batch. No accesses can be added afterwards until clear() is called.
+      * \return false if the batch is empty, invalid or still busy.
+      **/
+      bool submit()
+      {
+        if ((m_runs == 0) || busy())
+        {
+          return false;
+        }
+        if (m_open)
+        {
+          m_builder.end();
+          m_open = false;
+        }
+        if (!ok())
+        {
+          return false;
+        }
+        bool result = true;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+          for (size_t i = 0; i < m_runs; i++)
+          {
+            result = DMASPI::registerTransfer(m_transfers[i]) && result;
+          }
+        }
+        return result;
+      }
+
+      /** \brief Check if the batch is queued or in progress. **/
+      bool busy() const
+      {
+        for (size_t i = 0; i < m_runs; i++)
+        {
+          if (m_transfers[i].busy())
+          {
+            return true;
+          }
+        }
+        return false;
+      }
+
+      /** \brief Check if all accesses of the last submit() are done. **/
+      bool done() const
+      {
+        for (size_t i = 0; i < m_runs; i++)
+        {
+          if (!m_transfers[i].done())
+          {
+            return false;
+          }
+        }
+        return m_runs != 0;
+      }
+
+      /** \brief Wait until the batch is done, see AbstractDmaSpi::wait().
+      * \param timeout maximum time to wait in ms, 0 waits forever.
+      * \return true if all accesses are done.
+      **/
+      bool wait(const uint32_t& timeout = 0)
+      {
+        if (m_runs == 0)
+        {
+          return false;
+        }
+        // Transfers are handled in order, so the last one finishes last
+        DMASPI::wait(m_transfers[m_runs - 1], timeout);
+        return done();
+      }
+
+    private:
+      /** \brief start a new run and its program if the device changes **/
+      bool beginAccess_(const RegisterDevice& device)
+      {
+        if (!m_open)
+        {
+          return false;
+        }
+        if ((m_runs != 0) && (&device.cs == m_pDevice))
+        {
+          return true;
+        }
+        if (m_runs == MAX_RUNS)
+        {
+          return false;
+        }
+        if (m_runs != 0)
+        {
+          m_builder.end();
+          if (!m_builder.ok())
+          {
+            return false;
+          }
+          m_used += m_builder.length();
+        }
+        m_builder = program::Builder(m_program + m_used, PROGRAM_SIZE - m_used);
+        m_transfers[m_runs] = Transfer(Program(m_program + m_used), &device.cs);
+        m_runs++;
+        m_pDevice = &device.cs;
+        return true;
+      }
+
+      uint8_t m_program[PROGRAM_SIZE];
+      program::Builder m_builder;
+      Transfer m_transfers[MAX_RUNS];
+      const AbstractChipSelect* m_pDevice;
+      size_t m_used;
+      size_t m_runs;
+      bool m_open;
+      bool m_ok;
+  };
+} // namespace DmaSpi
+
+#endif // DMASPIREGISTERS_H
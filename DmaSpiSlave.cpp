@@ -0,0 +1,12 @@
+#include "DmaSpiSlave.h"
+
+#if defined(KINETISK)
+DmaSpiSlave0 DMASPISLAVE0;
+#if defined(__MK64FX512__) || defined(__MK66FX1M0__)
+DmaSpiSlave1 DMASPISLAVE1;
+#endif
+#elif defined (KINETISL)
+DmaSpiSlave0 DMASPISLAVE0;
+DmaSpiSlave1 DMASPISLAVE1;
+#else 
+#endif // defined
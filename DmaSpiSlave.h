@@ -0,0 +1,762 @@
+#ifndef DMASPISLAVE_H
+#define DMASPISLAVE_H
+
+#include "DmaSpi.h"
+
+namespace DmaSpi
+{
+  /** \brief A frame received by a DmaSpiSlave, i.e. the bytes clocked in while the master selected the slave.
+  **/
+  struct Frame
+  {
+    Frame(const uint32_t& start_ = 0, const uint32_t& length_ = 0)
+      : start(start_),
+      length(length_)
+    {}
+
+    uint32_t start; /**< position of the first byte, counted in bytes received since begin() **/
+    uint32_t length; /**< number of bytes in the frame **/
+  };
+
+  /** \brief Data a DmaSpiSlave sends to the master during one frame.
+  **/
+  class Response
+  {
+    public:
+      /** \brief The Response's current state.
+      **/
+      enum State
+      {
+        idle, /**< The Response is idle, the DmaSpiSlave has not seen it yet. **/
+        eDone, /**< The frame that sent the Response has ended. **/
+        pending, /**< Armed, waiting for the frames before it to end. **/
+        inProgress /**< Loaded into the SPI, the master can clock it out now. **/
+      };
+
+      /** \brief Creates a Response object.
+      * \param pSource pointer to the data to send. It must remain valid until the Response is done.
+      * \param count number of bytes to send, at most 32767. If the master clocks more bytes in this frame,
+      *   the slave's fill value is sent after them.
+      **/
+      Response(const uint8_t* pSource = nullptr, const uint16_t& count = 0)
+        : m_state(State::idle),
+        m_pSource(pSource),
+        m_count(count),
+        m_frameLength(0),
+        m_pNext(nullptr)
+      {}
+
+      /** \brief Check if the Response is armed or being sent. **/
+      bool busy() const {return ((m_state == State::pending) || (m_state == State::inProgress));}
+
+      /** \brief Check if the frame that sent the Response has ended. **/
+      bool done() const {return (m_state == State::eDone);}
+
+      /** \brief The number of bytes the master clocked in the frame that sent the Response. **/
+      uint32_t frameLength() const {return m_frameLength;}
+
+//      private:
+      volatile State m_state;
+      const uint8_t* m_pSource;
+      uint16_t m_count;
+      volatile uint32_t m_frameLength;
+      Response* m_pNext;
+  };
+} // namespace DmaSpi
+
+/** \brief SPI slave mode with DMA in both directions.
+ *
+ * - Received bytes are written into a ring buffer by a DMA channel that never stops, so no interrupt is needed per byte or per frame of data.
+ * - A frame ends when the master deasserts the slave's chip select. A pin interrupt then records the frame
+ *   (see nextFrame() and copyFrame()) and loads the next armed Response into the SPI, so that it is ready
+ *   before the master selects the slave again. The master must leave the chip select high long enough for that interrupt.
+ * - Without an armed Response, the fill value is sent.
+ *
+ * The SPI peripheral can't be used by the master mode DmaSpi or the SPI library at the same time.
+ * Like AbstractDmaSpi, all methods and variables are static, the chip-specific parts are in the derived classes.
+**/
+template<typename DMASPI_INSTANCE>
+class AbstractDmaSpiSlave
+{
+  public:
+    /** \brief The maximum number of received frames that are remembered until they are read with nextFrame(). **/
+    static const uint8_t frameQueueSize = 16;
+
+    /** \brief Set up the SPI as a slave and start receiving.
+     * \param pRing the ring buffer for received data. Its size must be a power of two between 16 and 16384 bytes, and
+     *   it must be aligned to its size, e.g. <tt>alignas(1024) volatile uint8_t ring[1024];</tt>
+     *   Frames must be shorter than the ring buffer.
+     * \param size the size of the ring buffer
+     * \param dataMode SPI_MODE0 .. SPI_MODE3, as used by the master.
+     *   Teensy LC: in modes 0 and 2, the master has to deassert the chip select after each byte.
+     * \param fill the byte that is sent when no Response is armed
+     * \return true if initialization was successful; false otherwise.
+    **/
+    static bool begin(volatile uint8_t* pRing, const size_t& size, const uint8_t& dataMode = SPI_MODE0, const uint8_t& fill = 0)
+    {
+      if (m_running_)
+      {
+        return true;
+      }
+      DMASPI_PRINT(("DmaSpiSlave::begin() : "));
+      if ((size < 16) || (size > 16384) || ((size & (size - 1)) != 0) || (((uintptr_t)pRing & (size - 1)) != 0))
+      {
+        DMASPI_PRINT(("ring buffer size or alignment\n"));
+        return false;
+      }
+      // rx first: on the Teensy LC, the lower channel number has the higher priority
+      if (m_rxChannel_.acquire() == nullptr)
+      {
+        DMASPI_PRINT(("could not acquire DMA channels\n"));
+        return false;
+      }
+      if (m_txChannel_.acquire() == nullptr)
+      {
+        m_rxChannel_.release();
+        DMASPI_PRINT(("could not acquire DMA channels\n"));
+        return false;
+      }
+      m_pRing_ = pRing;
+      m_ringMask_ = size - 1;
+      m_fill_ = fill;
+      m_received_ = 0;
+      m_lastOffset_ = 0;
+      m_frameHead_ = 0;
+      m_frameTail_ = 0;
+      m_droppedFrames_ = 0;
+      m_pCurrentResponse_ = nullptr;
+
+      // the SPI is halted until both channels are set up
+      begin_setup_spi(dataMode);
+
+      // rx: known source (SPI), circular destination, runs until end()
+      begin_setup_rxChannel();
+      rxChannel_()->destinationCircular(pRing, size);
+#if defined(KINETISL)
+      rxChannel_()->transferCount(rxCount_);
+#endif
+      if (rxChannel_()->error())
+      {
+        end_();
+        DMASPI_PRINT(("rx channel error\n"));
+        return false;
+      }
+
+      // tx: known destination (SPI), interrupt when the Response or fill data runs out
+      begin_setup_txChannel();
+      txChannel_()->disableOnCompletion();
+      txChannel_()->attachInterrupt(txIsr_);
+      txChannel_()->interruptAtCompletion();
+      loadResponse_();
+      if (txChannel_()->error())
+      {
+        end_();
+        DMASPI_PRINT(("tx channel error\n"));
+        return false;
+      }
+
+      rxChannel_()->enable();
+      txChannel_()->enable();
+      attachInterrupt(DMASPI_INSTANCE::csPin, csIsr_, RISING);
+      resume();
+      m_running_ = true;
+      DMASPI_PRINT(("ok\n"));
+      return true;
+    }
+
+    /** \brief Stop the SPI slave and release its DMA channels. Armed Responses are returned to the idle state.
+    **/
+    static void end()
+    {
+      if (m_running_)
+      {
+        end_();
+      }
+    }
+
+    /** \brief Check if the slave has been started with begin(). **/
+    static bool running() {return m_running_;}
+
+    /** \brief Arm a Response for one of the following frames. Responses are sent in the order they were armed,
+     * one per frame. A Response armed while a frame is in progress is sent in a later frame.
+     * \return true if the Response was armed, false if it is still busy or too long.
+    **/
+    static bool arm(DmaSpi::Response& response)
+    {
+      if (response.busy() || (response.m_count > 32767))
+      {
+        return false;
+      }
+      response.m_state = DmaSpi::Response::State::pending;
+      response.m_pNext = nullptr;
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+      {
+        if (m_pNextResponse_ == nullptr)
+        {
+          m_pNextResponse_ = &response;
+        }
+        else
+        {
+          m_pLastResponse_->m_pNext = &response;
+        }
+        m_pLastResponse_ = &response;
+      }
+      return true;
+    }
+
+    /** \brief The number of frames that can be read with nextFrame(). **/
+    static uint8_t available()
+    {
+      return (uint8_t)(m_frameHead_ - m_frameTail_);
+    }
+
+    /** \brief Get the oldest frame that hasn't been read yet.
+     * \return false if there is none.
+    **/
+    static bool nextFrame(DmaSpi::Frame& frame)
+    {
+      if (available() == 0)
+      {
+        return false;
+      }
+      frame = m_frames_[m_frameTail_ % frameQueueSize];
+      m_frameTail_ = m_frameTail_ + 1;
+      return true;
+    }
+
+    /** \brief Copy a frame out of the ring buffer.
+     * \param frame a frame returned by nextFrame()
+     * \param pDest where to copy the frame to
+     * \param maxCount the size of pDest
+     * \return the number of bytes copied, or 0 if the frame has already been overwritten by newer data.
+    **/
+    static size_t copyFrame(const DmaSpi::Frame& frame, uint8_t* pDest, const size_t& maxCount)
+    {
+      const size_t count = (frame.length < maxCount) ? frame.length : maxCount;
+      const size_t offset = frame.start & m_ringMask_;
+      const size_t first = (count < m_ringMask_ + 1 - offset) ? count : (m_ringMask_ + 1 - offset);
+      memcpy(pDest, (const void*)(m_pRing_ + offset), first);
+      memcpy(pDest + first, (const void*)m_pRing_, count - first);
+      // the DMA doesn't wait for us, check that it hasn't reached the frame again while we were copying
+      if (received_() - frame.start > m_ringMask_ + 1)
+      {
+        return 0;
+      }
+      return count;
+    }
+
+    /** \brief The number of frames that were lost because nextFrame() wasn't called often enough. **/
+    static uint32_t droppedFrames() {return m_droppedFrames_;}
+
+  protected:
+    static void begin_setup_spi(const uint8_t& dataMode) {DMASPI_INSTANCE::begin_setup_spi_impl(dataMode);}
+    static void begin_setup_txChannel() {DMASPI_INSTANCE::begin_setup_txChannel_impl();}
+    static void begin_setup_rxChannel() {DMASPI_INSTANCE::begin_setup_rxChannel_impl();}
+    static void halt() {DMASPI_INSTANCE::halt_impl();}
+    static void resume() {DMASPI_INSTANCE::resume_impl();}
+    static bool rxPending() {return DMASPI_INSTANCE::rxPending_impl();}
+    static void end_spi() {DMASPI_INSTANCE::end_spi_impl();}
+
+#if defined(KINETISK)
+    // the rx channel's major loop restarts forever, the fill data is restarted by txIsr_()
+    static const uint32_t fillCount_ = 32767;
+#elif defined(KINETISL)
+    // the channels stop when their byte count runs out and are restarted by rxIsr_() and txIsr_()
+    static const uint32_t rxCount_ = 0xFFFFF;
+    static const uint32_t fillCount_ = 0xFFFFF;
+#endif
+
+    static DMAChannel* rxChannel_()
+    {
+      return m_rxChannel_.get();
+    }
+
+    static DMAChannel* txChannel_()
+    {
+      return m_txChannel_.get();
+    }
+
+    static void end_()
+    {
+      detachInterrupt(DMASPI_INSTANCE::csPin);
+      end_spi();
+      m_rxChannel_.release();
+      m_txChannel_.release();
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+      {
+        if (m_pCurrentResponse_ != nullptr)
+        {
+          m_pCurrentResponse_->m_state = DmaSpi::Response::State::idle;
+          m_pCurrentResponse_ = nullptr;
+        }
+        for (DmaSpi::Response* pResponse = m_pNextResponse_; pResponse != nullptr; pResponse = pResponse->m_pNext)
+        {
+          pResponse->m_state = DmaSpi::Response::State::idle;
+        }
+        m_pNextResponse_ = nullptr;
+        m_pLastResponse_ = nullptr;
+      }
+      m_running_ = false;
+    }
+
+    /** \brief Check if a channel has really requested an interrupt, and not just left an NVIC entry behind. **/
+    static bool interruptPending_(DMAChannel* pChannel)
+    {
+#if defined(KINETISK)
+      return (DMA_INT & (1 << pChannel->channel)) != 0;
+#elif defined(KINETISL)
+      return (pChannel->CFG->DSR_BCR & DMA_DSR_BCR_DONE) != 0;
+#endif
+    }
+
+    /** \brief The ring buffer offset the rx channel writes to next. **/
+    static uint32_t rxOffset_()
+    {
+      return ((uintptr_t)rxChannel_()->destinationAddress() - (uintptr_t)m_pRing_) & m_ringMask_;
+    }
+
+    /** \brief The number of bytes received since begin(). **/
+    static uint32_t received_()
+    {
+      uint32_t result;
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+      {
+        result = m_received_ + ((rxOffset_() - m_lastOffset_) & m_ringMask_);
+      }
+      return result;
+    }
+
+    /** \brief Load the next armed Response into the tx channel, or the fill value if there is none.
+     * The tx channel must be disabled.
+    **/
+    static void loadResponse_()
+    {
+      m_pCurrentResponse_ = m_pNextResponse_;
+      if ((m_pCurrentResponse_ != nullptr) && (m_pCurrentResponse_->m_count != 0))
+      {
+        m_pNextResponse_ = m_pCurrentResponse_->m_pNext;
+        if (m_pNextResponse_ == nullptr)
+        {
+          m_pLastResponse_ = nullptr;
+        }
+        m_pCurrentResponse_->m_state = DmaSpi::Response::State::inProgress;
+        txChannel_()->sourceBuffer(m_pCurrentResponse_->m_pSource, m_pCurrentResponse_->m_count);
+      }
+      else
+      {
+        if (m_pCurrentResponse_ != nullptr)
+        {
+          // nothing to send, but the Response still takes up its frame
+          m_pNextResponse_ = m_pCurrentResponse_->m_pNext;
+          if (m_pNextResponse_ == nullptr)
+          {
+            m_pLastResponse_ = nullptr;
+          }
+          m_pCurrentResponse_->m_state = DmaSpi::Response::State::inProgress;
+        }
+        loadFill_();
+      }
+    }
+
+    static void loadFill_()
+    {
+      txChannel_()->source(m_fill_);
+      txChannel_()->transferCount(fillCount_);
+    }
+
+    /** \brief The Response or the fill data ran out before the frame ended: continue with the fill value. **/
+    static void txIsr_()
+    {
+      if (!interruptPending_(txChannel_()))
+      {
+        return;
+      }
+      txChannel_()->clearInterrupt();
+      loadFill_();
+      txChannel_()->enable();
+    }
+
+#if defined(KINETISL)
+    /** \brief Teensy LC: the rx channel stops when its byte count runs out, which takes about a million bytes. **/
+    static void rxIsr_()
+    {
+      if (!interruptPending_(rxChannel_()))
+      {
+        return;
+      }
+      rxChannel_()->clearInterrupt();
+      rxChannel_()->transferCount(rxCount_);
+      rxChannel_()->enable();
+    }
+#endif
+
+    /** \brief The master has deasserted the chip select: record the frame and load the next Response.
+    **/
+    static void csIsr_()
+    {
+      // let the rx channel pick up the last bytes of the frame
+      for (uint8_t i = 0; (i < 100) && rxPending(); i++) {}
+      const uint32_t offset = rxOffset_();
+      const uint32_t length = (offset - m_lastOffset_) & m_ringMask_;
+      if (length == 0)
+      {
+        // no data was clocked, the Response is still loaded
+        return;
+      }
+      DMASPI_PRINT(("DmaSpiSlave::csIsr_() : frame of %lu bytes\n", length));
+      m_lastOffset_ = offset;
+      if (available() < frameQueueSize)
+      {
+        m_frames_[m_frameHead_ % frameQueueSize] = DmaSpi::Frame((uint32_t)m_received_, length);
+        m_frameHead_ = m_frameHead_ + 1;
+      }
+      else
+      {
+        m_droppedFrames_++;
+      }
+      m_received_ += length;
+
+      // throw away what's left of this frame's tx data and get the next frame's data ready
+      halt();
+      txChannel_()->disable();
+      txChannel_()->clearInterrupt();
+      if (m_pCurrentResponse_ != nullptr)
+      {
+        m_pCurrentResponse_->m_frameLength = length;
+        m_pCurrentResponse_->m_state = DmaSpi::Response::State::eDone;
+      }
+      loadResponse_();
+      txChannel_()->enable();
+      resume();
+    }
+
+    static volatile bool m_running_;
+    static volatile uint8_t* m_pRing_;
+    static uint32_t m_ringMask_;
+    static uint8_t m_fill_;
+    static volatile uint32_t m_received_;
+    static volatile uint32_t m_lastOffset_;
+    static DmaSpi::Frame m_frames_[frameQueueSize];
+    static volatile uint8_t m_frameHead_;
+    static volatile uint8_t m_frameTail_;
+    static volatile uint32_t m_droppedFrames_;
+    static DmaSpi::Response* volatile m_pCurrentResponse_;
+    static DmaSpi::Response* volatile m_pNextResponse_;
+    static DmaSpi::Response* volatile m_pLastResponse_;
+    static DmaSpi::ChannelStorage m_rxChannel_;
+    static DmaSpi::ChannelStorage m_txChannel_;
+};
+
+template<typename DMASPI_INSTANCE>
+volatile bool AbstractDmaSpiSlave<DMASPI_INSTANCE>::m_running_ = false;
+
+template<typename DMASPI_INSTANCE>
+volatile uint8_t* AbstractDmaSpiSlave<DMASPI_INSTANCE>::m_pRing_ = nullptr;
+
+template<typename DMASPI_INSTANCE>
+uint32_t AbstractDmaSpiSlave<DMASPI_INSTANCE>::m_ringMask_ = 0;
+
+template<typename DMASPI_INSTANCE>
+uint8_t AbstractDmaSpiSlave<DMASPI_INSTANCE>::m_fill_ = 0;
+
+template<typename DMASPI_INSTANCE>
+volatile uint32_t AbstractDmaSpiSlave<DMASPI_INSTANCE>::m_received_ = 0;
+
+template<typename DMASPI_INSTANCE>
+volatile uint32_t AbstractDmaSpiSlave<DMASPI_INSTANCE>::m_lastOffset_ = 0;
+
+template<typename DMASPI_INSTANCE>
+DmaSpi::Frame AbstractDmaSpiSlave<DMASPI_INSTANCE>::m_frames_[AbstractDmaSpiSlave<DMASPI_INSTANCE>::frameQueueSize];
+
+template<typename DMASPI_INSTANCE>
+volatile uint8_t AbstractDmaSpiSlave<DMASPI_INSTANCE>::m_frameHead_ = 0;
+
+template<typename DMASPI_INSTANCE>
+volatile uint8_t AbstractDmaSpiSlave<DMASPI_INSTANCE>::m_frameTail_ = 0;
+
+template<typename DMASPI_INSTANCE>
+volatile uint32_t AbstractDmaSpiSlave<DMASPI_INSTANCE>::m_droppedFrames_ = 0;
+
+template<typename DMASPI_INSTANCE>
+DmaSpi::Response* volatile AbstractDmaSpiSlave<DMASPI_INSTANCE>::m_pCurrentResponse_ = nullptr;
+
+template<typename DMASPI_INSTANCE>
+DmaSpi::Response* volatile AbstractDmaSpiSlave<DMASPI_INSTANCE>::m_pNextResponse_ = nullptr;
+
+template<typename DMASPI_INSTANCE>
+DmaSpi::Response* volatile AbstractDmaSpiSlave<DMASPI_INSTANCE>::m_pLastResponse_ = nullptr;
+
+template<typename DMASPI_INSTANCE>
+DmaSpi::ChannelStorage AbstractDmaSpiSlave<DMASPI_INSTANCE>::m_rxChannel_;
+
+template<typename DMASPI_INSTANCE>
+DmaSpi::ChannelStorage AbstractDmaSpiSlave<DMASPI_INSTANCE>::m_txChannel_;
+
+#if defined(KINETISK)
+
+/** Teensy 3.x: the DSPI's data pins keep their direction in slave mode, so the master's MOSI goes to
+ * DIN (pin 12, labelled MISO) and the master's MISO to DOUT (pin 11). SCK is pin 13, the chip select pin 10.
+**/
+class DmaSpiSlave0 : public AbstractDmaSpiSlave<DmaSpiSlave0>
+{
+public:
+  static const uint8_t csPin = 10;
+
+  static void begin_setup_spi_impl(const uint8_t& dataMode)
+  {
+    SIM_SCGC6 |= SIM_SCGC6_SPI0;
+    SPI0_MCR = SPI_MCR_HALT | SPI_MCR_CLR_TXF | SPI_MCR_CLR_RXF;
+    SPI0_CTAR0_SLAVE = SPI_CTAR_FMSZ(7)
+      | ((dataMode & 0x08) ? SPI_CTAR_CPOL : 0)
+      | ((dataMode & 0x04) ? SPI_CTAR_CPHA : 0);
+    SPI0_SR = 0xFF0F0000;
+    SPI0_RSER = SPI_RSER_RFDF_RE | SPI_RSER_RFDF_DIRS | SPI_RSER_TFFF_RE | SPI_RSER_TFFF_DIRS;
+    CORE_PIN10_CONFIG = PORT_PCR_MUX(2);
+    CORE_PIN11_CONFIG = PORT_PCR_DSE | PORT_PCR_MUX(2);
+    CORE_PIN12_CONFIG = PORT_PCR_MUX(2);
+    CORE_PIN13_CONFIG = PORT_PCR_MUX(2);
+  }
+
+  static void begin_setup_txChannel_impl()
+  {
+    txChannel_()->disable();
+    txChannel_()->destination((volatile uint8_t&)SPI0_PUSHR_SLAVE);
+    txChannel_()->triggerAtHardwareEvent(DMAMUX_SOURCE_SPI0_TX);
+  }
+
+  static void begin_setup_rxChannel_impl()
+  {
+    rxChannel_()->disable();
+    rxChannel_()->source((volatile uint8_t&)SPI0_POPR);
+    rxChannel_()->triggerAtHardwareEvent(DMAMUX_SOURCE_SPI0_RX);
+  }
+
+  static void halt_impl()
+  {
+    SPI0_MCR |= SPI_MCR_HALT | SPI_MCR_CLR_TXF;
+    SPI0_SR = 0xFF0F0000;
+  }
+
+  static void resume_impl()
+  {
+    SPI0_MCR &= ~SPI_MCR_HALT;
+  }
+
+  static bool rxPending_impl()
+  {
+    return (SPI0_SR & SPI_SR_RXCTR) != 0;
+  }
+
+  static void end_spi_impl()
+  {
+    SPI0_RSER = 0;
+    SPI0_MCR = SPI_MCR_HALT | SPI_MCR_CLR_TXF | SPI_MCR_CLR_RXF;
+    SPI0_SR = 0xFF0F0000;
+  }
+
+private:
+};
+
+#if defined(__MK64FX512__) || defined(__MK66FX1M0__)
+
+/** Teensy 3.5, 3.6: the master's MOSI goes to DIN (pin 1), the master's MISO to DOUT (pin 0).
+ * SCK is pin 32, the chip select pin 31.
+**/
+class DmaSpiSlave1 : public AbstractDmaSpiSlave<DmaSpiSlave1>
+{
+public:
+  static const uint8_t csPin = 31;
+
+  static void begin_setup_spi_impl(const uint8_t& dataMode)
+  {
+    SIM_SCGC6 |= SIM_SCGC6_SPI1;
+    SPI1_MCR = SPI_MCR_HALT | SPI_MCR_CLR_TXF | SPI_MCR_CLR_RXF;
+    SPI1_CTAR0_SLAVE = SPI_CTAR_FMSZ(7)
+      | ((dataMode & 0x08) ? SPI_CTAR_CPOL : 0)
+      | ((dataMode & 0x04) ? SPI_CTAR_CPHA : 0);
+    SPI1_SR = 0xFF0F0000;
+    SPI1_RSER = SPI_RSER_RFDF_RE | SPI_RSER_RFDF_DIRS | SPI_RSER_TFFF_RE | SPI_RSER_TFFF_DIRS;
+    CORE_PIN31_CONFIG = PORT_PCR_MUX(2);
+    CORE_PIN0_CONFIG = PORT_PCR_DSE | PORT_PCR_MUX(2);
+    CORE_PIN1_CONFIG = PORT_PCR_MUX(2);
+    CORE_PIN32_CONFIG = PORT_PCR_MUX(2);
+  }
+
+  static void begin_setup_txChannel_impl()
+  {
+    txChannel_()->disable();
+    txChannel_()->destination((volatile uint8_t&)SPI1_PUSHR_SLAVE);
+    txChannel_()->triggerAtHardwareEvent(DMAMUX_SOURCE_SPI1_TX);
+  }
+
+  static void begin_setup_rxChannel_impl()
+  {
+    rxChannel_()->disable();
+    rxChannel_()->source((volatile uint8_t&)SPI1_POPR);
+    rxChannel_()->triggerAtHardwareEvent(DMAMUX_SOURCE_SPI1_RX);
+  }
+
+  static void halt_impl()
+  {
+    SPI1_MCR |= SPI_MCR_HALT | SPI_MCR_CLR_TXF;
+    SPI1_SR = 0xFF0F0000;
+  }
+
+  static void resume_impl()
+  {
+    SPI1_MCR &= ~SPI_MCR_HALT;
+  }
+
+  static bool rxPending_impl()
+  {
+    return (SPI1_SR & SPI_SR_RXCTR) != 0;
+  }
+
+  static void end_spi_impl()
+  {
+    SPI1_RSER = 0;
+    SPI1_MCR = SPI_MCR_HALT | SPI_MCR_CLR_TXF | SPI_MCR_CLR_RXF;
+    SPI1_SR = 0xFF0F0000;
+  }
+
+private:
+};
+
+extern DmaSpiSlave1 DMASPISLAVE1;
+
+#endif // defined(__MK64FX512__) || defined(__MK66FX1M0__)
+
+extern DmaSpiSlave0 DMASPISLAVE0;
+
+#elif defined(KINETISL)
+
+/** Teensy LC: MOSI is pin 11, MISO pin 12, SCK pin 13, the chip select pin 10.
+**/
+class DmaSpiSlave0 : public AbstractDmaSpiSlave<DmaSpiSlave0>
+{
+public:
+  static const uint8_t csPin = 10;
+
+  static void begin_setup_spi_impl(const uint8_t& dataMode)
+  {
+    SIM_SCGC4 |= SIM_SCGC4_SPI0;
+    // slave mode, SPI stays disabled until resume()
+    SPI0_C1 = dataMode & (SPI_C1_CPOL | SPI_C1_CPHA);
+    SPI0_C2 = SPI_C2_TXDMAE | SPI_C2_RXDMAE;
+    CORE_PIN10_CONFIG = PORT_PCR_MUX(2);
+    CORE_PIN11_CONFIG = PORT_PCR_MUX(2);
+    CORE_PIN12_CONFIG = PORT_PCR_DSE | PORT_PCR_MUX(2);
+    CORE_PIN13_CONFIG = PORT_PCR_MUX(2);
+  }
+
+  static void begin_setup_txChannel_impl()
+  {
+    txChannel_()->disable();
+    txChannel_()->destination((volatile uint8_t&)SPI0_DL);
+    txChannel_()->triggerAtHardwareEvent(DMAMUX_SOURCE_SPI0_TX);
+  }
+
+  static void begin_setup_rxChannel_impl()
+  {
+    rxChannel_()->disable();
+    rxChannel_()->source((volatile uint8_t&)SPI0_DL);
+    rxChannel_()->triggerAtHardwareEvent(DMAMUX_SOURCE_SPI0_RX);
+    rxChannel_()->attachInterrupt(rxIsr_);
+    rxChannel_()->interruptAtCompletion();
+  }
+
+  static void halt_impl()
+  {
+    // disabling the SPI drops the byte waiting in the transmit buffer
+    SPI0_C1 &= ~(SPI_C1_SPE);
+  }
+
+  static void resume_impl()
+  {
+    SPI0_C1 |= SPI_C1_SPE;
+  }
+
+  static bool rxPending_impl()
+  {
+    return (SPI0_S & SPI_S_SPRF) != 0;
+  }
+
+  static void end_spi_impl()
+  {
+    SPI0_C1 = 0;
+    SPI0_C2 = 0;
+  }
+
+private:
+};
+
+/** Teensy LC: MOSI is pin 0, MISO pin 1, SCK pin 20, the chip select pin 6.
+**/
+class DmaSpiSlave1 : public AbstractDmaSpiSlave<DmaSpiSlave1>
+{
+public:
+  static const uint8_t csPin = 6;
+
+  static void begin_setup_spi_impl(const uint8_t& dataMode)
+  {
+    SIM_SCGC4 |= SIM_SCGC4_SPI1;
+    // slave mode, SPI stays disabled until resume()
+    SPI1_C1 = dataMode & (SPI_C1_CPOL | SPI_C1_CPHA);
+    SPI1_C2 = SPI_C2_TXDMAE | SPI_C2_RXDMAE;
+    CORE_PIN6_CONFIG = PORT_PCR_MUX(2);
+    CORE_PIN0_CONFIG = PORT_PCR_MUX(2);
+    CORE_PIN1_CONFIG = PORT_PCR_DSE | PORT_PCR_MUX(2);
+    CORE_PIN20_CONFIG = PORT_PCR_MUX(2);
+  }
+
+  static void begin_setup_txChannel_impl()
+  {
+    txChannel_()->disable();
+    txChannel_()->destination((volatile uint8_t&)SPI1_DL);
+    txChannel_()->triggerAtHardwareEvent(DMAMUX_SOURCE_SPI1_TX);
+  }
+
+  static void begin_setup_rxChannel_impl()
+  {
+    rxChannel_()->disable();
+    rxChannel_()->source((volatile uint8_t&)SPI1_DL);
+    rxChannel_()->triggerAtHardwareEvent(DMAMUX_SOURCE_SPI1_RX);
+    rxChannel_()->attachInterrupt(rxIsr_);
+    rxChannel_()->interruptAtCompletion();
+  }
+
+  static void halt_impl()
+  {
+    // disabling the SPI drops the bytes waiting in the transmit FIFO
+    SPI1_C1 &= ~(SPI_C1_SPE);
+  }
+
+  static void resume_impl()
+  {
+    SPI1_C1 |= SPI_C1_SPE;
+  }
+
+  static bool rxPending_impl()
+  {
+    return (SPI1_S & SPI_S_SPRF) != 0;
+  }
+
+  static void end_spi_impl()
+  {
+    SPI1_C1 = 0;
+    SPI1_C2 = 0;
+  }
+
+private:
+};
+
+extern DmaSpiSlave0 DMASPISLAVE0;
+extern DmaSpiSlave1 DMASPISLAVE1;
+
+#else
+
+#error Unknown chip
+
+#endif // KINETISK else KINETISL
+
+#endif // DMASPISLAVE_H
@@ -0,0 +1,341 @@
+/** Host test for DmaSpi::NorFlash.
+ *
+ * FakeDmaSpi stands in for a DmaSpi: registerTransfer() queues the Transfer and wait() runs its program against
+ * a simulated W25Qxx style chip, so read aheads stay in flight until the cache waits for them.
+ * Transfer programs hold 32 bit pointers, so the flash object is placed in the low 4 GByte (MAP_32BIT, x86-64 Linux).
+**/
+
+#include "DmaSpi.h"
+#include "DmaSpiFlash.h"
+
+#include <cassert>
+#include <cstdio>
+#include <vector>
+#include <sys/mman.h>
+
+namespace
+{
+  const uint32_t chipSize = 1 << 20;
+  const uint32_t blockSize = 512;
+  uint8_t chip[chipSize];
+  bool writeEnabled = false;
+
+  int readCommands = 0;
+  std::vector<int> blockLoads(chipSize / blockSize); // per block
+  int pagePrograms = 0;
+  std::vector<uint32_t> programmed;
+
+  /** \brief execute the SPI frame between a select and a deselect **/
+  void endFrame(std::vector<uint8_t>& frame)
+  {
+    if (frame.empty())
+    {
+      return;
+    }
+    const uint32_t address = (frame.size() >= 4) ? ((frame[1] << 16) | (frame[2] << 8) | frame[3]) % chipSize : 0;
+    switch (frame[0])
+    {
+      case 0x06: // write enable
+        writeEnabled = true;
+        break;
+      case 0x02: // page program
+        assert(writeEnabled);
+        for (size_t i = 4; i < frame.size(); i++)
+        {
+          const uint32_t target = address + i - 4;
+          assert((target & ~255u) == (address & ~255u)); // a page program must not cross a page boundary
+          chip[target] &= frame[i];
+        }
+        programmed.push_back(address);
+        pagePrograms++;
+        writeEnabled = false;
+        break;
+      case 0x20: // sector erase
+        assert(writeEnabled);
+        memset(chip + (address & ~4095u), 0xFF, 4096);
+        writeEnabled = false;
+        break;
+    }
+    frame.clear();
+  }
+
+  uint16_t argument16(const uint8_t* p) {return p[0] | (p[1] << 8);}
+  uint8_t* argumentPointer(const uint8_t* p)
+  {
+    uint32_t address;
+    memcpy(&address, p, 4);
+    return (uint8_t*)(uintptr_t)address;
+  }
+
+  /** \brief interpret a Transfer program **/
+  void runProgram(const uint8_t* p)
+  {
+    std::vector<uint8_t> frame;
+    uint32_t readAddress = 0;
+    bool reading = false;
+    for (;;)
+    {
+      const uint8_t op = *p++;
+      switch (op)
+      {
+        case DmaSpi::program::eEnd:
+          return;
+        case DmaSpi::program::eSelect:
+          break;
+        case DmaSpi::program::eDeselect:
+          endFrame(frame);
+          reading = false;
+          break;
+        case DmaSpi::program::eWrite:
+          frame.insert(frame.end(), p + 1, p + 1 + p[0]);
+          p += 1 + p[0];
+          break;
+        case DmaSpi::program::eWriteRows:
+        {
+          const uint8_t* pSource = argumentPointer(p);
+          const uint16_t length = argument16(p + 4);
+          const uint16_t stride = argument16(p + 6);
+          const uint16_t rows = argument16(p + 8);
+          for (uint16_t row = 0; row < rows; row++)
+          {
+            frame.insert(frame.end(), pSource + row * stride, pSource + row * stride + length);
+          }
+          p += 10;
+          break;
+        }
+        case DmaSpi::program::eRead:
+        {
+          uint8_t* pDest = argumentPointer(p);
+          const uint16_t count = argument16(p + 4);
+          p += 6;
+          if (frame[0] == 0x05)
+          {
+            *pDest = 0; // status: never busy
+            break;
+          }
+          assert((frame[0] == 0x0B) && (frame.size() == 5)); // fast read: command, address, dummy byte
+          if (!reading)
+          {
+            readAddress = (frame[1] << 16) | (frame[2] << 8) | frame[3];
+            reading = true;
+            readCommands++;
+          }
+          memcpy(pDest, chip + readAddress, count);
+          blockLoads[readAddress / blockSize]++;
+          readAddress += count;
+          break;
+        }
+        default:
+          assert(!"unexpected program step");
+      }
+    }
+  }
+
+  struct FakeDmaSpi
+  {
+    static bool registerTransfer(DmaSpi::Transfer& transfer)
+    {
+      assert(pPending_ == nullptr);
+      transfer.m_state = DmaSpi::Transfer::State::pending;
+      pPending_ = &transfer;
+      return true;
+    }
+
+    static bool wait(const DmaSpi::Transfer& transfer, const uint32_t& = 0)
+    {
+      if (pPending_ != nullptr)
+      {
+        if (cancelNext)
+        {
+          pPending_->m_state = DmaSpi::Transfer::State::cancelled;
+          cancelNext = false;
+        }
+        else
+        {
+          runProgram(pPending_->m_pProgram);
+          pPending_->m_state = DmaSpi::Transfer::State::eDone;
+        }
+        pPending_ = nullptr;
+      }
+      return transfer.done();
+    }
+
+    /** \brief forget a Transfer left in flight by the previous test **/
+    static void reset()
+    {
+      pPending_ = nullptr;
+      cancelNext = false;
+    }
+
+    /** \brief cancel the next Transfer instead of running it **/
+    static bool cancelNext;
+
+    private:
+      static DmaSpi::Transfer* pPending_;
+  };
+
+  bool FakeDmaSpi::cancelNext = false;
+  DmaSpi::Transfer* FakeDmaSpi::pPending_ = nullptr;
+
+  struct NoChipSelect : AbstractChipSelect
+  {
+    void select() override {}
+    void deselect() override {}
+  } cs;
+
+  typedef DmaSpi::NorFlash<FakeDmaSpi, blockSize, 4, 2> Flash;
+
+  template<typename FLASH = Flash>
+  FLASH* newFlash()
+  {
+    static void* pMemory = mmap(nullptr, sizeof(FLASH), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    assert(pMemory != MAP_FAILED);
+    return new (pMemory) FLASH(cs);
+  }
+
+  bool blockIs(const uint8_t* pData, const uint32_t& block)
+  {
+    return memcmp(pData, chip + block * Flash::blockSize, Flash::blockSize) == 0;
+  }
+
+  void fillChip()
+  {
+    for (uint32_t i = 0; i < chipSize; i++)
+    {
+      chip[i] = i * 7 + (i >> 8);
+    }
+  }
+
+  void testLruEviction()
+  {
+    Flash& flash = *newFlash();
+    // not sequential, so nothing is read ahead
+    const uint32_t blocks[] = {10, 20, 30, 40};
+    for (uint32_t block : blocks)
+    {
+      assert(blockIs(flash.read(block), block));
+    }
+    assert(readCommands == 4);
+    flash.read(10); // hit, 20 is now the least recently used block
+    assert(readCommands == 4);
+    assert(blockIs(flash.read(50), 50));
+    assert(readCommands == 5);
+    flash.read(10);
+    flash.read(30);
+    flash.read(40);
+    assert(readCommands == 5);
+    assert(blockIs(flash.read(20), 20));
+    assert(readCommands == 6);
+  }
+
+  void testReadAheadScatter()
+  {
+    Flash& flash = *newFlash();
+    // block 0 is loaded by one command, blocks 1 and 2 by a second one that scatters into two cache slots
+    assert(blockIs(flash.read(0), 0));
+    assert(readCommands == 1);
+    assert(blockIs(flash.read(1), 1));
+    assert(blockIs(flash.read(2), 2));
+    assert(readCommands == 2);
+    for (uint32_t block = 3; block < 16; block++)
+    {
+      assert(blockIs(flash.read(block), block));
+    }
+    printf("  16 sequential blocks: %d read commands\n", readCommands);
+    assert(readCommands < 16);
+  }
+
+  /** \brief read 32 blocks sequentially, each must be loaded only once **/
+  template<size_t CACHE_BLOCKS, size_t READ_AHEAD>
+  void testReadAheadKeepsPrefetched()
+  {
+    typedef DmaSpi::NorFlash<FakeDmaSpi, blockSize, CACHE_BLOCKS, READ_AHEAD> Flash;
+    Flash& flash = *newFlash<Flash>();
+    for (uint32_t block = 0; block < 32; block++)
+    {
+      assert(memcmp(flash.read(block), chip + block * Flash::blockSize, Flash::blockSize) == 0);
+    }
+    printf("  %u slots, %u read ahead: %d read commands\n", (unsigned)CACHE_BLOCKS, (unsigned)READ_AHEAD, readCommands);
+    for (uint32_t block = 0; block < 32; block++)
+    {
+      assert(blockLoads[block] == 1);
+    }
+    assert(readCommands <= 1 + (int)((31 + READ_AHEAD - 1) / READ_AHEAD) * 2);
+  }
+
+  void testDirtyWriteBack()
+  {
+    Flash& flash = *newFlash();
+    uint8_t data[Flash::blockSize];
+    for (size_t i = 0; i < sizeof(data); i++)
+    {
+      data[i] = i ^ 0x5A;
+    }
+
+    flash.eraseSector(16);
+    for (uint32_t i = 0; i < 4096; i++)
+    {
+      assert(chip[16 * Flash::blockSize + i] == 0xFF);
+    }
+    flash.write(17, data);
+    flash.write(16, data);
+    flash.write(18, data);
+    assert(pagePrograms == 0); // write-back: nothing is written before flush()
+    flash.flush();
+    assert(pagePrograms == 6);
+    for (size_t i = 1; i < programmed.size(); i++)
+    {
+      assert(programmed[i - 1] < programmed[i]); // address order
+    }
+    for (uint32_t block = 16; block < 19; block++)
+    {
+      assert(memcmp(chip + block * Flash::blockSize, data, Flash::blockSize) == 0);
+    }
+
+    // a dirty block is written back when it's evicted
+    flash.eraseSector(24);
+    flash.write(24, data);
+    for (uint32_t i = 0; i < 8; i++)
+    {
+      flash.read(50 + 5 * i);
+    }
+    assert(memcmp(chip + 24 * Flash::blockSize, data, Flash::blockSize) == 0);
+    assert(memcmp(flash.read(24), data, Flash::blockSize) == 0);
+  }
+
+  void testCancelledLoad()
+  {
+    Flash& flash = *newFlash();
+    assert(blockIs(flash.read(0), 0));
+    // the read ahead of blocks 1 and 2 is cancelled, so they must not be served from the cache
+    FakeDmaSpi::cancelNext = true;
+    assert(blockIs(flash.read(1), 1));
+    assert(readCommands == 2);
+    assert(blockIs(flash.read(2), 2));
+  }
+
+  void run(void (*test)(), const char* name)
+  {
+    printf("%s\n", name);
+    FakeDmaSpi::reset();
+    fillChip();
+    readCommands = 0;
+    blockLoads.assign(blockLoads.size(), 0);
+    pagePrograms = 0;
+    programmed.clear();
+    test();
+  }
+} // namespace
+
+int main()
+{
+  run(testLruEviction, "LRU eviction");
+  run(testReadAheadScatter, "read ahead scatter");
+  run(testReadAheadKeepsPrefetched<4, 3>, "read ahead keeps prefetched blocks");
+  run(testReadAheadKeepsPrefetched<8, 4>, "read ahead keeps prefetched blocks");
+  run(testReadAheadKeepsPrefetched<8, 6>, "read ahead keeps prefetched blocks");
+  run(testDirtyWriteBack, "dirty write-back");
+  run(testCancelledLoad, "cancelled load");
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include "core_pins.h"
+#define OUTPUT 1
+#define INPUT 0
+#define RISING 3
+#define FALLING 2
+#define CHANGE 4
+#define LOW 0
+#define HIGH 1
+struct SerialStub { template<typename...A> void printf(A...){} void flush(){} template<typename T> void println(T){} };
+extern SerialStub Serial;
+inline void __disable_irq() {}
+inline void __enable_irq() {}
+#define ARM_DWT_CYCCNT (*(volatile uint32_t*)0x1)
+class IntervalTimer { public: bool begin(void (*)(), unsigned int); void end(); };
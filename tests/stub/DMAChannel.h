@@ -0,0 +1,66 @@
+#pragma once
+#include <stdint.h>
+#include "kinetis.h"
+class DMABaseClass {
+public:
+#ifdef KINETISK
+  typedef struct __attribute__((packed, aligned(4))) {
+    volatile const void * volatile SADDR;
+    int16_t SOFF;
+    union { uint16_t ATTR; struct { uint8_t ATTR_DST; uint8_t ATTR_SRC; }; };
+    union { uint32_t NBYTES; uint32_t NBYTES_MLNO; uint32_t NBYTES_MLOFFNO; uint32_t NBYTES_MLOFFYES; };
+    int32_t SLAST;
+    volatile void * volatile DADDR;
+    int16_t DOFF;
+    union { volatile uint16_t CITER; volatile uint16_t CITER_ELINKYES; volatile uint16_t CITER_ELINKNO; };
+    int32_t DLASTSGA;
+    volatile uint16_t CSR;
+    union { volatile uint16_t BITER; volatile uint16_t BITER_ELINKYES; volatile uint16_t BITER_ELINKNO; };
+  } TCD_t;
+  TCD_t *TCD;
+#else
+  typedef struct __attribute__((packed, aligned(4))) {
+    volatile const void * volatile SAR;
+    volatile void * volatile DAR;
+    volatile uint32_t DSR_BCR;
+    volatile uint32_t DCR;
+  } CFG_t;
+  CFG_t *CFG;
+#endif
+  void source(volatile const uint8_t &p);
+  void sourceBuffer(volatile const uint8_t p[], unsigned int len);
+  void sourceCircular(volatile const uint8_t p[], unsigned int len);
+  void destination(volatile uint8_t &p);
+  void destinationBuffer(volatile uint8_t p[], unsigned int len);
+  void destinationCircular(volatile uint8_t p[], unsigned int len);
+  void transferSize(unsigned int len);
+  void transferCount(unsigned int len);
+  void interruptAtCompletion();
+  void interruptAtHalf();
+  void disableOnCompletion();
+  void replaceSettingsOnCompletion(const DMABaseClass &settings);
+  volatile const void * sourceAddress();
+  volatile void * destinationAddress();
+};
+class DMAChannel : public DMABaseClass {
+public:
+  DMAChannel() { begin(); }
+  ~DMAChannel() { release(); }
+  void begin(bool force_initialization = false);
+  void release();
+  void triggerAtHardwareEvent(uint8_t source);
+  void triggerAtTransfersOf(DMABaseClass &ch);
+  void triggerAtCompletionOf(DMABaseClass &ch);
+  void triggerContinuously();
+  void triggerManual();
+  void enable();
+  void disable();
+  void attachInterrupt(void (*isr)(void));
+  void detachInterrupt();
+  void clearInterrupt();
+  void clearError();
+  bool error();
+  bool complete();
+  void clearComplete();
+  uint8_t channel;
+};
@@ -0,0 +1,9 @@
+#pragma once
+#include <stdint.h>
+struct SPISettings { SPISettings(uint32_t=4000000, uint8_t=0, uint8_t=0){} };
+struct SPIClass { void begin(); void end(); void beginTransaction(SPISettings); void endTransaction(); uint8_t transfer(uint8_t); };
+extern SPIClass SPI; extern SPIClass SPI1;
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+#define SPI_MODE2 0x08
+#define SPI_MODE3 0x0C
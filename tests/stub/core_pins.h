@@ -0,0 +1,12 @@
+#pragma once
+#include <stdint.h>
+void pinMode(uint8_t, uint8_t);
+void digitalWriteFast(uint8_t, uint8_t);
+uint8_t digitalReadFast(uint8_t);
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t);
+void delayMicroseconds(uint32_t);
+void attachInterrupt(uint8_t, void (*)(), int);
+void detachInterrupt(uint8_t);
+#include "kinetis.h"
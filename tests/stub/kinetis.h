@@ -0,0 +1,125 @@
+#pragma once
+#include <stdint.h>
+#define REG32(a) (*(volatile uint32_t*)(a))
+#define REG16(a) (*(volatile uint16_t*)(a))
+#define REG8(a) (*(volatile uint8_t*)(a))
+#ifdef KINETISK
+#define SPI0_PUSHR REG32(0x4002C034)
+#define SPI0_POPR REG32(0x4002C038)
+#define SPI0_SR REG32(0x4002C02C)
+#define SPI0_RSER REG32(0x4002C030)
+#define SPI0_MCR REG32(0x4002C000)
+#define SPI0_CTAR0_SLAVE REG32(0x4002C00C)
+#define SPI0_PUSHR_SLAVE REG32(0x4002C034)
+#define SPI1_PUSHR REG32(0x4002D034)
+#define SPI1_POPR REG32(0x4002D038)
+#define SPI1_SR REG32(0x4002D02C)
+#define SPI1_RSER REG32(0x4002D030)
+#define SPI1_MCR REG32(0x4002D000)
+#define SPI1_CTAR0_SLAVE REG32(0x4002D00C)
+#define SPI1_PUSHR_SLAVE REG32(0x4002D034)
+#define SPI_RSER_RFDF_RE 1
+#define SPI_RSER_RFDF_DIRS 2
+#define SPI_RSER_TFFF_RE 4
+#define SPI_RSER_TFFF_DIRS 8
+#define SPI_MCR_CLR_TXF 0x800
+#define SPI_MCR_CLR_RXF 0x400
+#define SPI_MCR_HALT 1
+#define SPI_MCR_MSTR 0x80000000
+#define SPI_MCR_PCSIS(n) (((n) & 0x1F)<<16)
+#define SPI_CTAR_FMSZ(n) (((n) & 15) << 27)
+#define SPI_SR_TCF 0x80000000
+#define SPI_SR_TXRXS 0x40000000
+#define SPI_SR_RXCTR 0x000000F0
+#define SPI_CTAR_CPOL 0x04000000
+#define SPI_CTAR_CPHA 0x02000000
+#define SPI_SR_EOQF 0x10000000
+#define SPI_SR_TFUF 0x08000000
+#define SPI_SR_RFOF 0x00080000
+#define DMAMUX_SOURCE_SPI0_RX 16
+#define DMAMUX_SOURCE_SPI0_TX 17
+#define DMAMUX_SOURCE_SPI1_RX 18
+#define DMAMUX_SOURCE_SPI1_TX 19
+#define DMA_DCHPRI3 REG8(0x40008100)
+#define DMA_DCHPRI_ECP 0x80
+#define DMA_DCHPRI_DPA 0x40
+#define DMA_DCHPRI_CHPRI(n) ((n) & 15)
+#define DMA_CR REG32(0x40008000)
+#define DMA_CR_ERCA 4
+#define DMA_CR_EMLM 0x80
+#define DMA_TCD_CSR_BWC(n) (((n) & 3) << 14)
+#define DMA_TCD_CSR_INTMAJOR 2
+#define DMA_TCD_CSR_MAJORELINK 0x20
+#define DMA_TCD_CSR_DREQ 8
+#define DMA_TCD_CSR_DONE 0x80
+#define DMA_TCD_ATTR_SMOD(n) (((n) & 0x1F) << 11)
+#if defined(__MK66FX1M0__)
+#define DMA_NUM_CHANNELS 32
+#elif defined(__MK20DX128__)
+#define DMA_NUM_CHANNELS 4
+#else
+#define DMA_NUM_CHANNELS 16
+#endif
+#define DMA_CR_GRP0PRI 0x100
+#define DMA_CR_GRP1PRI 0x400
+#define DMA_TCD_CSR_ACTIVE 0x40
+#define DMA_TCD_CSR_START 0x01
+#define DMA_INT REG32(0x40008024)
+#define CRC_CRC REG32(0x40032000)
+#define CRC_GPOLY REG32(0x40032004)
+#define CRC_CTRL REG32(0x40032008)
+#define CRC_CTRL_TOT(n) (((n) & 3) << 30)
+#define CRC_CTRL_TOTR(n) (((n) & 3) << 28)
+#define CRC_CTRL_FXOR 0x04000000
+#define CRC_CTRL_WAS 0x02000000
+#define CRC_CTRL_TCRC 0x01000000
+#define SIM_SCGC6 REG32(0x4004803C)
+#define SIM_SCGC6_CRC 0x40000
+#define SIM_SCGC6_SPI0 0x1000
+#define SIM_SCGC6_SPI1 0x2000
+#else
+#define SPI0_DL REG8(0x40076006)
+#define SPI0_S REG8(0x40076000)
+#define SPI0_C1 REG8(0x40076002)
+#define SPI0_C2 REG8(0x40076003)
+#define SPI1_DL REG8(0x40077006)
+#define SPI1_S REG8(0x40077000)
+#define SPI1_C1 REG8(0x40077002)
+#define SPI1_C2 REG8(0x40077003)
+#define SPI_C1_SPE 0x40
+#define SPI_C1_CPOL 0x08
+#define SPI_C1_CPHA 0x04
+#define SPI_S_SPRF 0x80
+#define SPI_S_SPTEF 0x20
+#define SPI_C1_MSTR 0x10
+#define SPI_C1_SSOE 0x02
+#define SPI_C2_TXDMAE 0x20
+#define SPI_C2_RXDMAE 0x04
+#define DMAMUX_SOURCE_SPI0_RX 16
+#define DMAMUX_SOURCE_SPI0_TX 17
+#define DMAMUX_SOURCE_SPI1_RX 18
+#define DMAMUX_SOURCE_SPI1_TX 19
+#define DMA_DCR_SMOD(n) (((n) & 15) << 12)
+#define DMA_DCR_DMOD(n) (((n) & 15) << 8)
+#define DMA_DCR_CS 0x20000000
+#define DMA_DCR_LINKCC(n) (((n) & 3) << 4)
+#define DMA_NUM_CHANNELS 4
+#define DMA_DSR_BCR_DONE 0x01000000
+#define SIM_SCGC4 REG32(0x40048034)
+#define SIM_SCGC4_SPI0 0x400000
+#define SIM_SCGC4_SPI1 0x800000
+#endif
+#define PORT_PCR_MUX(n) (((n) & 7) << 8)
+#define PORT_PCR_DSE 0x40
+#define CORE_PIN0_CONFIG REG32(0x40049000 + 0)
+#define CORE_PIN1_CONFIG REG32(0x40049000 + 4)
+#define CORE_PIN6_CONFIG REG32(0x40049000 + 24)
+#define CORE_PIN10_CONFIG REG32(0x40049000 + 40)
+#define CORE_PIN11_CONFIG REG32(0x40049000 + 44)
+#define CORE_PIN12_CONFIG REG32(0x40049000 + 48)
+#define CORE_PIN13_CONFIG REG32(0x40049000 + 52)
+#define CORE_PIN20_CONFIG REG32(0x40049000 + 80)
+#define CORE_PIN31_CONFIG REG32(0x40049000 + 124)
+#define CORE_PIN32_CONFIG REG32(0x40049000 + 128)
+#define SYST_CVR REG32(0xE000E018)
+#define SYST_RVR REG32(0xE000E014)